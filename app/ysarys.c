@@ -17,12 +17,16 @@
 
 #include "../lib/date.h"
 #include "../lib/db_migrate.h"
+#include "../lib/db_stmt_cache.h"
 #include "../lib/intdef.h"
 #include "../lib/log.h"
 #include "../lib/rule.h"
+#include "../lib/rule_index.h"
 #include "../lib/scan.h"
+#include "../lib/status_file.h"
 #include <sqlite3.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -34,11 +38,17 @@ enum
 
 struct scheduler
 {
-	int id;
-	const char *rule;
-	const char *description;
-	const char *tags_csv;
-	int monetary_value;
+	sqlite3_int64 id;
+	struct rule *rule;
+	/* `tags_csv` shares this allocation. */
+	char *description;
+	usize description_count;
+	char *tags_csv;
+	usize tags_csv_count;
+	sqlite3_int64 monetary_value;
+	/* `rule` was compiled from text, its stored blob is missing or
+	 * outdated. */
+	int rule_stale;
 };
 
 void
@@ -60,9 +70,9 @@ usage(void)
 }
 
 static int
-agenda_archive(sqlite3 *db, int agenda_id)
+agenda_archive(struct db_stmt_cache *cache, int agenda_id)
 {
-	const char sql[] =
+	static const char sql[] =
 	    "INSERT INTO agenda_archive (scheduler_id, scheduler_archive_id, "
 	    "description, tags_csv, monetary_value, due_at, archived_at) "
 	    "SELECT scheduler_id, scheduler_archive_id, description, tags_csv, "
@@ -78,10 +88,10 @@ agenda_archive(sqlite3 *db, int agenda_id)
 		goto _done;
 	}
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "agenda_archive.prepare");
+		sqlite_print_error(cache->db, "agenda_archive.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -91,7 +101,7 @@ agenda_archive(sqlite3 *db, int agenda_id)
 		r = sqlite3_bind_int(stmt, 2, agenda_id);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "agenda_archive.bind");
+		sqlite_print_error(cache->db, "agenda_archive.bind");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -99,7 +109,7 @@ agenda_archive(sqlite3 *db, int agenda_id)
 	r = sqlite3_step(stmt);
 	if (r != SQLITE_DONE)
 	{
-		sqlite_print_error(db, "agenda_archive.step");
+		sqlite_print_error(cache->db, "agenda_archive.step");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -107,21 +117,21 @@ agenda_archive(sqlite3 *db, int agenda_id)
 	r = YSARYS_OK;
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
 static int
-agenda_delete(sqlite3 *db, int agenda_id)
+agenda_delete(struct db_stmt_cache *cache, int agenda_id)
 {
-	const char sql[] = "DELETE FROM agenda WHERE id = ?";
+	static const char sql[] = "DELETE FROM agenda WHERE id = ?";
 	sqlite3_stmt *stmt = NULL;
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "agenda_delete.prepare");
+		sqlite_print_error(cache->db, "agenda_delete.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -129,7 +139,7 @@ agenda_delete(sqlite3 *db, int agenda_id)
 	r = sqlite3_bind_int(stmt, 1, agenda_id);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "agenda_delete.bind");
+		sqlite_print_error(cache->db, "agenda_delete.bind");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -137,7 +147,7 @@ agenda_delete(sqlite3 *db, int agenda_id)
 	r = sqlite3_step(stmt);
 	if (r != SQLITE_DONE)
 	{
-		sqlite_print_error(db, "agenda_delete.step");
+		sqlite_print_error(cache->db, "agenda_delete.step");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -145,12 +155,12 @@ agenda_delete(sqlite3 *db, int agenda_id)
 	r = YSARYS_OK;
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
 static int
-agenda_rm(sqlite3 *db, int argc, const char *argv[])
+agenda_rm(struct db_stmt_cache *cache, int argc, const char *argv[])
 {
 	int agenda_id = 0;
 	int r = 0;
@@ -168,11 +178,11 @@ agenda_rm(sqlite3 *db, int argc, const char *argv[])
 		goto _done;
 	}
 
-	r = agenda_archive(db, agenda_id);
+	r = agenda_archive(cache, agenda_id);
 	if (r != YSARYS_OK)
 		goto _done;
 
-	r = agenda_delete(db, agenda_id);
+	r = agenda_delete(cache, agenda_id);
 	if (r != YSARYS_OK)
 		goto _done;
 
@@ -182,7 +192,7 @@ _done:
 }
 
 static int
-agenda_add(sqlite3 *db, int argc, const char *argv[])
+agenda_add(struct db_stmt_cache *cache, int argc, const char *argv[])
 {
 	struct date arg_due = DATE_ZERO;
 	const char *arg_description = NULL;
@@ -205,17 +215,17 @@ _done:
 }
 
 static int
-scheduler_list(sqlite3 *db)
+scheduler_list(struct db_stmt_cache *cache)
 {
-	(void)db;
+	(void)cache;
 	/* TODO(tnegri): scheduler_list */
 	return YSARYS_E;
 }
 
 static int
-scheduler_rm(sqlite3 *db, int argc, const char *argv[])
+scheduler_rm(struct db_stmt_cache *cache, int argc, const char *argv[])
 {
-	(void)db;
+	(void)cache;
 	(void)argc;
 	(void)argv;
 	/* TODO(tnegri): scheduler_rm */
@@ -223,9 +233,9 @@ scheduler_rm(sqlite3 *db, int argc, const char *argv[])
 }
 
 static int
-scheduler_add(sqlite3 *db, int argc, const char *argv[])
+scheduler_add(struct db_stmt_cache *cache, int argc, const char *argv[])
 {
-	(void)db;
+	(void)cache;
 	(void)argc;
 	(void)argv;
 	/* TODO(tnegri): scheduler_add */
@@ -233,18 +243,18 @@ scheduler_add(sqlite3 *db, int argc, const char *argv[])
 }
 
 sqlite3_int64
-select_last_run_time(sqlite3 *db)
+select_last_run_time(struct db_stmt_cache *cache)
 {
 	sqlite3_stmt *stmt = NULL;
-	const char sql[] =
+	static const char sql[] =
 	    "SELECT last_run_at_timestamp FROM scheduler_control WHERE id = 1";
 	int r = 0;
 	sqlite3_int64 last_run = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "select_last_run_time.prepare");
+		sqlite_print_error(cache->db, "select_last_run_time.prepare");
 		last_run = 0;
 		goto _done;
 	}
@@ -261,32 +271,31 @@ select_last_run_time(sqlite3 *db)
 			goto _done;
 
 		default:
-			sqlite_print_error(db, "select_last_run_time.step");
+			sqlite_print_error(cache->db,
+			                   "select_last_run_time.step");
 			last_run = 0;
 			goto _done;
 	}
 
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 
 	return last_run;
 }
 
 int
-select_scheduler(sqlite3 *db, sqlite3_stmt **stmt)
+select_scheduler(struct db_stmt_cache *cache, sqlite3_stmt **stmt)
 {
-	const char sql[] = "SELECT id, rule, description, tags_csv, "
-	                   "monetary_value FROM scheduler";
+	static const char sql[] =
+	    "SELECT id, rule, description, tags_csv, monetary_value, "
+	    "rule_blob, rule_blob_version FROM scheduler";
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "select_scheduler.prepare");
-		if (*stmt != NULL)
-			sqlite3_finalize(*stmt);
-
+		sqlite_print_error(cache->db, "select_scheduler.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -296,69 +305,90 @@ _done:
 	return r;
 }
 
-void
-next(struct weekdate *date)
+/* Runs `sql`, a statement with no parameters nor rows. */
+static int
+db_exec(struct db_stmt_cache *cache, const char *sql, const char *tag)
 {
-	date->week_day = (date->week_day + 1) % 7;
+	sqlite3_stmt *stmt = NULL;
+	int r = 0;
 
-	if (date->day < date_month_last_day(date->year, date->month))
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		date->day += 1;
-		return;
+		sqlite_print_error(cache->db, tag);
+		r = YSARYS_E;
+		goto _done;
 	}
-	date->day = 1;
 
-	if (date->month < MONTH_DECEMBER)
+	r = sqlite3_step(stmt);
+	if (r != SQLITE_DONE)
 	{
-		date->month = date->month + 1;
-		return;
+		sqlite_print_error(cache->db, tag);
+		r = YSARYS_E;
+		goto _done;
 	}
-	date->month = MONTH_JANUARY;
 
-	date->year += 1;
+	r = YSARYS_OK;
+_done:
+	if (stmt != NULL)
+		db_stmt_cache_release(stmt);
+	return r;
 }
 
-int
-compare(struct date *a, struct date *b)
+/* Days are stored as the timestamp of their midnight, UTC. */
+static sqlite_int64
+day_to_timestamp(daynum day)
 {
-	if (a->year < b->year)
-		return -1;
-	if (a->year > b->year)
-		return 1;
-	if (a->month < b->month)
-		return -1;
-	if (a->month > b->month)
-		return 1;
-	if (a->day < b->day)
-		return -1;
-	if (a->day > b->day)
-		return 1;
-	return 0;
+	return (sqlite_int64)day * SECS_PER_DAY;
 }
 
+static daynum
+day_from_timestamp(sqlite_int64 timestamp)
+{
+	sqlite_int64 day = 0;
+
+	day = timestamp / SECS_PER_DAY;
+	if (timestamp % SECS_PER_DAY < 0)
+		day -= 1;
+	return (daynum)day;
+}
+
+/* Does nothing when the scheduler already has an entry on `due_at`. */
 static int
-agenda_exists(sqlite3 *db, sqlite_int64 scheduler_id, sqlite_int64 due_at,
-              int *ret_exists)
+agenda_insert(struct db_stmt_cache *cache, sqlite_int64 scheduler_id,
+              const char *description, usize description_count,
+              const char *tags_csv, usize tags_csv_count,
+              sqlite_int64 monetary_value, sqlite_int64 due_at)
 {
 	sqlite3_stmt *stmt = NULL;
-	const char sql[] = "SELECT 1 FROM agenda WHERE scheduler_id = ? AND "
-	                   "due_at = ? LIMIT 1";
+	static const char sql[] =
+	    "INSERT INTO agenda (scheduler_id, description, tags_csv, "
+	    "monetary_value, due_at) VALUES (?, ?, ?, ?, ?) "
+	    "ON CONFLICT (scheduler_id, due_at) DO NOTHING";
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "agenda_exists.prepare");
+		sqlite_print_error(cache->db, "agenda_insert.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
 
 	r = sqlite3_bind_int64(stmt, 1, scheduler_id);
 	if (r == SQLITE_OK)
-		r = sqlite3_bind_int64(stmt, 2, due_at);
+		r = sqlite3_bind_blob(stmt, 2, description, description_count,
+		                      SQLITE_STATIC);
+	if (r == SQLITE_OK)
+		r = sqlite3_bind_blob(stmt, 3, tags_csv, tags_csv_count,
+		                      SQLITE_STATIC);
+	if (r == SQLITE_OK)
+		r = sqlite3_bind_int64(stmt, 4, monetary_value);
+	if (r == SQLITE_OK)
+		r = sqlite3_bind_int64(stmt, 5, due_at);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "agenda_exists.bind");
+		sqlite_print_error(cache->db, "agenda_insert.bind");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -367,61 +397,41 @@ agenda_exists(sqlite3 *db, sqlite_int64 scheduler_id, sqlite_int64 due_at,
 	switch (r)
 	{
 		case SQLITE_DONE:
-			*ret_exists = 0;
-			r = YSARYS_OK;
-			goto _done;
-
-		case SQLITE_ROW:
-			*ret_exists = 1;
 			r = YSARYS_OK;
 			goto _done;
 
 		default:
-			sqlite_print_error(db, "agenda_exists.step");
+			sqlite_print_error(cache->db, "agenda_insert.step");
 			r = YSARYS_E;
 			goto _done;
 	}
 
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
-static int
-agenda_insert(sqlite3 *db, sqlite_int64 scheduler_id, const char *description,
-              usize description_count, const char *tags_csv,
-              usize tags_csv_count, sqlite_int64 monetary_value,
-              sqlite_int64 due_at)
+int
+update_last_run(struct db_stmt_cache *cache, daynum day)
 {
 	sqlite3_stmt *stmt = NULL;
-	const char sql[] = "INSERT INTO agenda (scheduler_id, description, "
-	                   "tags_csv, monetary_value, due_at)"
-	                   " VALUES (?, ?, ?, ?, ?)";
+	static const char sql[] = "REPLACE INTO scheduler_control (id, "
+	                          "last_run_at_timestamp) VALUES (1, ?)";
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "agenda_insert.prepare");
+		sqlite_print_error(cache->db, "update_last_run.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
 
-	r = sqlite3_bind_int64(stmt, 1, scheduler_id);
-	if (r == SQLITE_OK)
-		r = sqlite3_bind_blob(stmt, 2, description, description_count,
-		                      SQLITE_STATIC);
-	if (r == SQLITE_OK)
-		r = sqlite3_bind_blob(stmt, 3, tags_csv, tags_csv_count,
-		                      SQLITE_STATIC);
-	if (r == SQLITE_OK)
-		r = sqlite3_bind_int64(stmt, 4, monetary_value);
-	if (r == SQLITE_OK)
-		r = sqlite3_bind_int64(stmt, 5, due_at);
+	r = sqlite3_bind_int64(stmt, 1, day_to_timestamp(day));
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "agenda_insert.bind");
+		sqlite_print_error(cache->db, "update_last_run.bind");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -434,253 +444,578 @@ agenda_insert(sqlite3 *db, sqlite_int64 scheduler_id, const char *description,
 			goto _done;
 
 		default:
-			sqlite_print_error(db, "agenda_insert.step");
+			sqlite_print_error(cache->db, "update_last_run.step");
 			r = YSARYS_E;
 			goto _done;
 	}
 
+	r = YSARYS_OK;
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
-int
-update_last_run(sqlite3 *db, struct date *date)
+static void
+scheduler_array_free(struct scheduler *array, usize count)
+{
+	usize i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		rule_free(array[i].rule);
+		free(array[i].description);
+	}
+	free(array);
+}
+
+/* Stores the compiled form of the stale rules, so the next run loads them
+ * as-is. */
+static int
+scheduler_rule_store(struct db_stmt_cache *cache, struct scheduler *array,
+                     usize count)
 {
 	sqlite3_stmt *stmt = NULL;
-	const char sql[] = "REPLACE INTO scheduler_control (id, "
-	                   "last_run_at_timestamp) VALUES (1, ?)";
+	static const char sql[] = "UPDATE scheduler SET rule_blob = ?, "
+	                          "rule_blob_version = ? WHERE id = ?";
+	usize i = 0;
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	for (i = 0; i < count; i++)
 	{
-		sqlite_print_error(db, "update_last_run.prepare");
-		r = YSARYS_E;
-		goto _done;
+		if (!array[i].rule_stale)
+			continue;
+
+		if (stmt != NULL)
+			db_stmt_cache_release(stmt);
+		r = db_stmt_cache_get(cache, sql, &stmt);
+		if (r != DB_STMT_CACHE_OK)
+		{
+			sqlite_print_error(cache->db,
+			                   "scheduler_rule_store.prepare");
+			r = YSARYS_E;
+			goto _done;
+		}
+
+		r = sqlite3_bind_blob(stmt, 1, array[i].rule,
+		                      rule_size(array[i].rule), SQLITE_STATIC);
+		if (r == SQLITE_OK)
+			r = sqlite3_bind_int(stmt, 2, RULE_BLOB_VERSION);
+		if (r == SQLITE_OK)
+			r = sqlite3_bind_int64(stmt, 3, array[i].id);
+		if (r != SQLITE_OK)
+		{
+			sqlite_print_error(cache->db,
+			                   "scheduler_rule_store.bind");
+			r = YSARYS_E;
+			goto _done;
+		}
+
+		r = sqlite3_step(stmt);
+		if (r != SQLITE_DONE)
+		{
+			sqlite_print_error(cache->db,
+			                   "scheduler_rule_store.step");
+			r = YSARYS_E;
+			goto _done;
+		}
+		array[i].rule_stale = 0;
 	}
 
-	r = sqlite3_bind_int64(stmt, 1, date_to_time(date));
-	if (r != SQLITE_OK)
-	{
-		sqlite_print_error(db, "update_last_run.bind");
-		r = YSARYS_E;
+	r = YSARYS_OK;
+_done:
+	if (stmt != NULL)
+		db_stmt_cache_release(stmt);
+	return r;
+}
+
+/* Reads every scheduler row, loading rules from their compiled form when
+ * it's current and compiling them otherwise. */
+static int
+scheduler_load_alloc(struct db_stmt_cache *cache, struct scheduler **ret_array,
+                     usize *ret_count)
+{
+	sqlite3_stmt *stmt = NULL;
+	struct scheduler *array = NULL;
+	struct scheduler *new_array = NULL;
+	struct scheduler *scheduler = NULL;
+	usize capacity = 0;
+	usize count = 0;
+	const char *rule = NULL;
+	int rule_count = 0;
+	const char *description = NULL;
+	const char *tags_csv = NULL;
+	int r = 0;
+
+	r = select_scheduler(cache, &stmt);
+	if (r != YSARYS_OK)
 		goto _done;
-	}
 
-	r = sqlite3_step(stmt);
-	switch (r)
+	while ((r = sqlite3_step(stmt)) == SQLITE_ROW)
 	{
-		case SQLITE_DONE:
-			r = YSARYS_OK;
+		if (count == capacity)
+		{
+			capacity = (capacity == 0) ? 16 : capacity * 2;
+			new_array =
+			    realloc(array, sizeof(struct scheduler) * capacity);
+			if (new_array == NULL)
+			{
+				log_error("Out of memory.");
+				r = YSARYS_E;
+				goto _done;
+			}
+			array = new_array;
+		}
+
+		scheduler = &array[count];
+		scheduler->id = sqlite3_column_int64(stmt, 0);
+		rule = (const char *)sqlite3_column_text(stmt, 1);
+		rule_count = sqlite3_column_bytes(stmt, 1);
+		description = (const char *)sqlite3_column_text(stmt, 2);
+		scheduler->description_count = sqlite3_column_bytes(stmt, 2);
+		tags_csv = (const char *)sqlite3_column_text(stmt, 3);
+		scheduler->tags_csv_count = sqlite3_column_bytes(stmt, 3);
+		scheduler->monetary_value = sqlite3_column_int64(stmt, 4);
+
+		r = RULE_EINVALBLOB;
+		if (sqlite3_column_int(stmt, 6) == RULE_BLOB_VERSION)
+			r = rule_load_alloc(sqlite3_column_blob(stmt, 5),
+			                    sqlite3_column_bytes(stmt, 5),
+			                    &scheduler->rule);
+		scheduler->rule_stale = (r != RULE_OK);
+		if (r == RULE_EINVALBLOB)
+			r = rule_compile(rule, rule_count, &scheduler->rule);
+		if (r != RULE_OK)
+		{
+			log_error(
+			    "Failed to compile rule '%s'. Return code: %d",
+			    rule, r);
+			r = YSARYS_E;
 			goto _done;
+		}
 
-		default:
-			sqlite_print_error(db, "update_last_run.step");
+		/* Column text doesn't outlive the step. */
+		scheduler->description = malloc(scheduler->description_count +
+		                                scheduler->tags_csv_count + 1);
+		if (scheduler->description == NULL)
+		{
+			rule_free(scheduler->rule);
+			log_error("Out of memory.");
 			r = YSARYS_E;
 			goto _done;
+		}
+		scheduler->tags_csv =
+		    &scheduler->description[scheduler->description_count];
+		memcpy(scheduler->description, description,
+		       scheduler->description_count);
+		memcpy(scheduler->tags_csv, tags_csv,
+		       scheduler->tags_csv_count);
+		count++;
+	}
+
+	if (r != SQLITE_DONE)
+	{
+		sqlite_print_error(cache->db, "scheduler_load.step");
+		r = YSARYS_E;
+		goto _done;
 	}
 
+	r = scheduler_rule_store(cache, array, count);
+	if (r != YSARYS_OK)
+		goto _done;
+
+	*ret_array = array;
+	*ret_count = count;
+	array = NULL;
+
 	r = YSARYS_OK;
 _done:
+	if (array != NULL)
+		scheduler_array_free(array, count);
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
+static int
+scheduler_put(struct db_stmt_cache *cache, struct scheduler *scheduler,
+              sqlite_int64 due_at)
+{
+	return agenda_insert(cache, scheduler->id, scheduler->description,
+	                     scheduler->description_count,
+	                     scheduler->tags_csv, scheduler->tags_csv_count,
+	                     scheduler->monetary_value, due_at);
+}
+
+/* Every day from `from` up to, not including, `to` that `scheduler` is
+ * due. Jumps from match to match, for days the index would walk one by
+ * one to find few or none. */
+static int
+scheduler_catch_up(struct db_stmt_cache *cache, struct scheduler *scheduler,
+                   daynum from, daynum to)
+{
+	daynum day = 0;
+	int r = 0;
+
+	while (from < to &&
+	       rule_next_match(scheduler->rule, from, &day) == RULE_OK &&
+	       day < to)
+	{
+		r = scheduler_put(cache, scheduler, day_to_timestamp(day));
+		if (r != YSARYS_OK)
+			return r;
+		from = day + 1;
+	}
+
+	return YSARYS_OK;
+}
+
 int
-scheduler_populate(sqlite3 *db, struct weekdate *today, int populate_from_today)
+scheduler_populate(struct db_stmt_cache *cache, daynum today,
+                   int populate_from_today)
 {
-	struct weekdate check_start_date = WEEKDATE_ZERO;
-	struct weekdate *check_start = NULL;
-	struct weekdate check_end = WEEKDATE_ZERO;
-	struct weekdate current = WEEKDATE_ZERO;
-	sqlite3_stmt *stmt_scheduler = NULL;
+	struct calendar cal = CALENDAR_ZERO;
+	struct scheduler *scheduler_array = NULL;
+	struct rule **rule_array = NULL;
+	struct rule_index *index = NULL;
+	u64 *match_bitmap = NULL;
+	usize scheduler_count = 0;
+	daynum check_start = 0;
+	daynum check_end = 0;
 	sqlite3_int64 last_run = 0;
-	sqlite3_int64 scheduler_id = 0;
-	const char *scheduler_rule = NULL;
-	int scheduler_rule_count = 0;
-	const char *scheduler_description = NULL;
-	int scheduler_description_count;
-	const char *scheduler_tags_csv = NULL;
-	int scheduler_tags_csv_count = 0;
-	sqlite3_int64 scheduler_monetary_value = 0;
-	struct rule *rule = NULL;
-	time_t due_at = 0;
-	int exists = 0;
+	sqlite_int64 due_at = 0;
+	usize i = 0;
+	int bit = 0;
+	int in_transaction = 0;
 	int r = 0;
 
+	/* One transaction for the whole run: a single journal sync, and a
+	 * failed run leaves nothing behind. IMMEDIATE so a concurrent run
+	 * waits here instead of failing on its first insert. */
+	r = db_exec(cache, "BEGIN IMMEDIATE", "scheduler_populate.begin");
+	if (r != YSARYS_OK)
+		goto _done;
+	in_transaction = 1;
+
 	check_start = today;
 
-	last_run = select_last_run_time(db);
+	last_run = select_last_run_time(cache);
 	if (last_run != 0)
 	{
-		weekdate_from_time(last_run, &check_start_date);
 		if (!populate_from_today ||
-		    date_compare((struct date *)&check_start_date,
-		                 (struct date *)today) < 0)
-			check_start = &check_start_date;
+		    day_from_timestamp(last_run) < today)
+			check_start = day_from_timestamp(last_run);
 	}
 
-	weekdate_add_days(today, 60, &check_end);
+	check_end = today + 60;
 
-	r = select_scheduler(db, &stmt_scheduler);
+	r = scheduler_load_alloc(cache, &scheduler_array, &scheduler_count);
 	if (r != YSARYS_OK)
 		goto _done;
 
-	while ((r = sqlite3_step(stmt_scheduler)) == SQLITE_ROW)
+	/* Without schedulers the run still goes on to update last_run, the
+	 * buffers just can't be 0 bytes, malloc may give NULL for those. */
+	rule_array = malloc(sizeof(struct rule *) *
+	                    (scheduler_count > 0 ? scheduler_count : 1));
+	if (rule_array == NULL)
 	{
-		scheduler_id = sqlite3_column_int64(stmt_scheduler, 0);
-		scheduler_rule = sqlite3_column_text(stmt_scheduler, 1);
-		scheduler_rule_count = sqlite3_column_bytes(stmt_scheduler, 1);
-		scheduler_description = sqlite3_column_text(stmt_scheduler, 2);
-		scheduler_description_count =
-		    sqlite3_column_bytes(stmt_scheduler, 2);
-		scheduler_tags_csv = sqlite3_column_text(stmt_scheduler, 3);
-		scheduler_tags_csv_count =
-		    sqlite3_column_bytes(stmt_scheduler, 3);
-		scheduler_monetary_value =
-		    sqlite3_column_int64(stmt_scheduler, 4);
+		log_error("Out of memory.");
+		r = YSARYS_E;
+		goto _done;
+	}
+	for (i = 0; i < scheduler_count; i++)
+		rule_array[i] = scheduler_array[i].rule;
 
-		r = rule_compile(scheduler_rule, scheduler_rule_count, &rule);
-		if (r != RULE_OK)
+	if (rule_index_alloc(rule_array, scheduler_count, &index) !=
+	    RULE_INDEX_OK)
+	{
+		log_error("Out of memory.");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	match_bitmap = malloc(sizeof(u64) *
+	                      (index->word_count > 0 ? index->word_count : 1));
+	if (match_bitmap == NULL)
+	{
+		log_error("Out of memory.");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	/* Days missed since the last run, however many, cost one step per
+	 * match. */
+	if (check_start < today)
+	{
+		for (i = 0; i < scheduler_count; i++)
 		{
-			log_error(
-			    "Failed to compile rule '%s'. Return code: %d",
-			    scheduler_rule, r);
-			r = YSARYS_E;
-			goto _done;
+			r = scheduler_catch_up(cache, &scheduler_array[i],
+			                       check_start, today);
+			if (r != YSARYS_OK)
+				goto _done;
 		}
+		check_start = today;
+	}
 
-		for (current = *check_start;
-		     compare((struct date *)&current,
-		             (struct date *)&check_end) <= 0;
-		     next(&current))
+	/* Day by day over the horizon, only the schedulers the index hands
+	 * back are looked at. */
+	for (calendar_init(&cal, check_start); cal.day <= check_end;
+	     calendar_next(&cal))
+	{
+		if (rule_index_match(index, &cal, match_bitmap) == 0)
+			continue;
+
+		due_at = day_to_timestamp(cal.day);
+		for (i = 0; i < index->word_count; i++)
 		{
-			if (rule_matches(rule, &current))
+			for (bit = 0; bit < 64 && (match_bitmap[i] >> bit) != 0;
+			     bit++)
 			{
-				due_at = date_to_time((struct date *)&current);
+				if (((match_bitmap[i] >> bit) & 1) == 0)
+					continue;
 
-				r = agenda_exists(db, scheduler_id, due_at,
-				                  &exists);
+				r = scheduler_put(
+				    cache, &scheduler_array[i * 64 + bit],
+				    due_at);
 				if (r != YSARYS_OK)
 					goto _done;
-
-				/*
-				printf("%d-%d-%d <%d> %lld: (%s) '%s' [%s]
-				$%lld\n", current.year, current.month,
-				current.day, exists, scheduler_id,
-				scheduler_rule, scheduler_description,
-				scheduler_tags_csv, scheduler_monetary_value);
-				       */
-
-				if (!exists)
-				{
-					r = agenda_insert(
-					    db, scheduler_id,
-					    scheduler_description,
-					    scheduler_description_count,
-					    scheduler_tags_csv,
-					    scheduler_tags_csv_count,
-					    scheduler_monetary_value, due_at);
-					if (r != YSARYS_OK)
-						goto _done;
-				}
 			}
 		}
-
-		rule_free(rule);
 	}
 
-	r = update_last_run(db, (struct date *)&check_end);
+	r = update_last_run(cache, check_end);
 	if (r != YSARYS_OK)
 		goto _done;
 
+	r = db_exec(cache, "COMMIT", "scheduler_populate.commit");
+	if (r != YSARYS_OK)
+		goto _done;
+	in_transaction = 0;
+
 	r = YSARYS_OK;
 _done:
-	if (stmt_scheduler != NULL)
-		sqlite3_finalize(stmt_scheduler);
+	if (in_transaction)
+		db_exec(cache, "ROLLBACK", "scheduler_populate.rollback");
+	if (match_bitmap != NULL)
+		free(match_bitmap);
+	if (index != NULL)
+		rule_index_free(index);
+	if (rule_array != NULL)
+		free(rule_array);
+	if (scheduler_array != NULL)
+		scheduler_array_free(scheduler_array, scheduler_count);
 	return r;
 }
 
+/* Rows read per query. Listing continues after the last row printed, so
+ * each page is an index search instead of an OFFSET scan. */
+#define AGENDA_LIST_PAGE_COUNT 64
+
 static int
-agenda_list_due(sqlite3 *db, struct date *today, struct date *near_future,
-                struct date *future)
+agenda_list_due(struct db_stmt_cache *cache, daynum today, daynum near_future,
+                daynum future)
 {
 	sqlite3_stmt *stmt = NULL;
-	const char sql[] = "SELECT id, scheduler_id, scheduler_archive_id, "
-	                   "description, tags_csv, monetary_value, due_at"
-	                   " FROM agenda ORDER BY due_at DESC, id DESC";
+	static const char sql[] =
+	    "SELECT id, scheduler_id, scheduler_archive_id, description, "
+	    "tags_csv, monetary_value, due_at FROM agenda "
+	    "WHERE (due_at, id) < (?, ?) "
+	    "ORDER BY due_at DESC, id DESC LIMIT ?";
 	sqlite_int64 agenda_id = 0;
 	const char *agenda_description = NULL;
 	sqlite_int64 agenda_due_at = 0;
-	struct weekdate date = WEEKDATE_ZERO;
-	int print_details = 0;
+	daynum day = 0;
+	int row_count = 0;
 	int r = 0;
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
-	{
-		sqlite_print_error(db, "agenda_list_due.prepate");
-		r = YSARYS_E;
-		goto _done;
-	}
+	/* Everything due up to `future`, overdue entries included. */
+	agenda_due_at = day_to_timestamp(future + 1);
+	agenda_id = 0;
 
-	while ((r = sqlite3_step(stmt)) == SQLITE_ROW)
+	do
 	{
-		agenda_id = sqlite3_column_int64(stmt, 0);
-		agenda_description = sqlite3_column_text(stmt, 3);
-		agenda_due_at = sqlite3_column_int64(stmt, 6);
-
-		print_details = 0;
+		r = db_stmt_cache_get(cache, sql, &stmt);
+		if (r != DB_STMT_CACHE_OK)
+		{
+			sqlite_print_error(cache->db,
+			                   "agenda_list_due.prepare");
+			r = YSARYS_E;
+			goto _done;
+		}
 
-		weekdate_from_time(agenda_due_at, &date);
-		if (date_compare(today, (struct date *)&date) >= 0)
+		r = sqlite3_bind_int64(stmt, 1, agenda_due_at);
+		if (r == SQLITE_OK)
+			r = sqlite3_bind_int64(stmt, 2, agenda_id);
+		if (r == SQLITE_OK)
+			r = sqlite3_bind_int(stmt, 3, AGENDA_LIST_PAGE_COUNT);
+		if (r != SQLITE_OK)
 		{
-			fprintf(stdout, "\x001b[31mDue      -- ");
-			print_details = 1;
+			sqlite_print_error(cache->db, "agenda_list_due.bind");
+			r = YSARYS_E;
+			goto _done;
 		}
-		else if (date_compare(near_future, (struct date *)&date) >= 0)
+
+		row_count = 0;
+		while ((r = sqlite3_step(stmt)) == SQLITE_ROW)
 		{
-			fprintf(stdout, "\x001b[33mSoon     -- ");
-			print_details = 1;
+			row_count++;
+			agenda_id = sqlite3_column_int64(stmt, 0);
+			agenda_description = sqlite3_column_text(stmt, 3);
+			agenda_due_at = sqlite3_column_int64(stmt, 6);
+
+			day = day_from_timestamp(agenda_due_at);
+			if (day <= today)
+				fprintf(stdout, "\x001b[31mDue      -- ");
+			else if (day <= near_future)
+				fprintf(stdout, "\x001b[33mSoon     -- ");
+			else
+				fprintf(stdout, "\x001b[32mUpcoming -- ");
+
+			daynum_fprintf(stdout, day);
+			fprintf(stdout, "  %d   %s\x001b[0m\n", (int)agenda_id,
+			        agenda_description);
 		}
-		else if (date_compare(future, (struct date *)&date) >= 0)
+
+		if (r != SQLITE_DONE)
 		{
-			fprintf(stdout, "\x001b[32mUpcoming -- ");
-			print_details = 1;
+			sqlite_print_error(cache->db, "agenda_list_due.step");
+			r = YSARYS_E;
+			goto _done;
 		}
 
-		if (print_details)
+		db_stmt_cache_release(stmt);
+		stmt = NULL;
+	} while (row_count == AGENDA_LIST_PAGE_COUNT);
+
+	r = YSARYS_OK;
+_done:
+	if (stmt != NULL)
+		db_stmt_cache_release(stmt);
+	return r;
+}
+
+/* A status snapshot answers for this long after it's saved, as long as the
+ * database isn't touched. */
+#define STATUS_SNAPSHOT_DAYS 7
+
+/* Saves the due dates `status` counts, for status_fast. Failing to save the
+ * file is not an error, the next status just reads the database. */
+static int
+status_snapshot(struct db_stmt_cache *cache, time_t now)
+{
+	static const char count_sql[] =
+	    "SELECT COUNT(1) FROM agenda WHERE due_at <= ?";
+	static const char due_sql[] =
+	    "SELECT due_at FROM agenda WHERE due_at > ? AND due_at <= ? "
+	    "ORDER BY due_at LIMIT ?";
+	struct status_file snapshot;
+	sqlite3_stmt *stmt = NULL;
+	const char *db_filename = NULL;
+	sqlite_int64 due_at = 0;
+	int r = 0;
+
+	memset(&snapshot, 0, sizeof snapshot);
+	snapshot.written_at = now;
+	snapshot.until = now + STATUS_SNAPSHOT_DAYS * SECS_PER_DAY;
+
+	/* Stamped before the queries, status_file_write drops the snapshot if a
+	 * commit lands in between. */
+	db_filename = sqlite3_db_filename(cache->db, "main");
+	if (db_filename == NULL || db_filename[0] == '\0' ||
+	    status_file_stamp(db_filename, &snapshot) != STATUS_FILE_OK)
+	{
+		r = YSARYS_OK;
+		goto _done;
+	}
+
+	r = db_stmt_cache_get(cache, count_sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
+	{
+		sqlite_print_error(cache->db, "status_snapshot.prepare.count");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	r = sqlite3_bind_int64(stmt, 1, now);
+	if (r != SQLITE_OK)
+	{
+		sqlite_print_error(cache->db, "status_snapshot.bind.count");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	r = sqlite3_step(stmt);
+	if (r != SQLITE_ROW)
+	{
+		sqlite_print_error(cache->db, "status_snapshot.step.count");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	snapshot.overdue_count = sqlite3_column_int64(stmt, 0);
+
+	db_stmt_cache_release(stmt);
+	stmt = NULL;
+
+	r = db_stmt_cache_get(cache, due_sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
+	{
+		sqlite_print_error(cache->db, "status_snapshot.prepare.due");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	r = sqlite3_bind_int64(stmt, 1, now);
+	if (r == SQLITE_OK)
+		r = sqlite3_bind_int64(stmt, 2, snapshot.until);
+	if (r == SQLITE_OK)
+		r = sqlite3_bind_int(stmt, 3, STATUS_FILE_DUE_MAX + 1);
+	if (r != SQLITE_OK)
+	{
+		sqlite_print_error(cache->db, "status_snapshot.bind.due");
+		r = YSARYS_E;
+		goto _done;
+	}
+
+	while ((r = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		due_at = sqlite3_column_int64(stmt, 0);
+		if (snapshot.due_count == STATUS_FILE_DUE_MAX)
 		{
-			date_fprintf(stdout, (struct date *)&date);
-			fprintf(stdout, "  %d   %s\x001b[0m\n", (int)agenda_id,
-			        agenda_description);
+			/* No room for this one, the snapshot ends just before
+			 * it, along with whatever else is due at the same
+			 * time. */
+			snapshot.until = due_at - 1;
+			while (snapshot.due_count > 0 &&
+			       snapshot.due_array[snapshot.due_count - 1] >
+			           snapshot.until)
+				snapshot.due_count--;
+			break;
 		}
+		snapshot.due_array[snapshot.due_count++] = due_at;
 	}
 
-	if (r != SQLITE_DONE)
+	if (r != SQLITE_ROW && r != SQLITE_DONE)
 	{
-		sqlite_print_error(db, "agenda_list_due.step");
+		sqlite_print_error(cache->db, "status_snapshot.step.due");
 		r = YSARYS_E;
 		goto _done;
 	}
 
+	status_file_write(db_filename, &snapshot);
+
 	r = YSARYS_OK;
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
 int
-run(sqlite3 *db, int populate_from_today)
+run(struct db_stmt_cache *cache, int populate_from_today)
 {
 	time_t now = 0;
-	struct weekdate today = WEEKDATE_ZERO;
-	struct weekdate near_future_ref_date = WEEKDATE_ZERO;
-	struct weekdate future_ref_date = WEEKDATE_ZERO;
+	daynum today = 0;
 	int r = 0;
 
 	now = time(NULL);
@@ -690,17 +1025,17 @@ run(sqlite3 *db, int populate_from_today)
 		goto _done;
 	}
 
-	weekdate_from_time(now, &today);
-	weekdate_add_days(&today, 7, &near_future_ref_date);
-	weekdate_add_days(&today, 15, &future_ref_date);
+	today = daynum_from_time(now);
 
-	r = scheduler_populate(db, &today, populate_from_today);
+	r = scheduler_populate(cache, today, populate_from_today);
 	if (r != YSARYS_OK)
 		goto _done;
 
-	r = agenda_list_due(db, (struct date *)&today,
-	                    (struct date *)&near_future_ref_date,
-	                    (struct date *)&future_ref_date);
+	r = status_snapshot(cache, now);
+	if (r != YSARYS_OK)
+		goto _done;
+
+	r = agenda_list_due(cache, today, today + 7, today + 15);
 	if (r != YSARYS_OK)
 		goto _done;
 
@@ -710,15 +1045,16 @@ _done:
 }
 
 static int
-agenda_list(sqlite3 *db)
+agenda_list(struct db_stmt_cache *cache)
 {
-	return run(db, 0);
+	return run(cache, 0);
 }
 
 static int
-status(sqlite3 *db)
+status(struct db_stmt_cache *cache)
 {
-	const char sql[] = "SELECT COUNT(1) FROM agenda WHERE due_at <= ?";
+	static const char sql[] =
+	    "SELECT COUNT(1) FROM agenda WHERE due_at <= ?";
 	sqlite3_stmt *stmt = NULL;
 	time_t now = 0;
 	time_t tomorrow = 0;
@@ -736,10 +1072,10 @@ status(sqlite3 *db)
 	tomorrow = now + SECS_PER_DAY;
 	three_days = now + (3 * SECS_PER_DAY);
 
-	r = sqlite3_prepare_v2(db, sql, sizeof(sql), &stmt, NULL);
-	if (r != SQLITE_OK)
+	r = db_stmt_cache_get(cache, sql, &stmt);
+	if (r != DB_STMT_CACHE_OK)
 	{
-		sqlite_print_error(db, "status.prepare");
+		sqlite_print_error(cache->db, "status.prepare");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -747,7 +1083,7 @@ status(sqlite3 *db)
 	r = sqlite3_bind_int64(stmt, 1, tomorrow);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "status.bind.tomorrow");
+		sqlite_print_error(cache->db, "status.bind.tomorrow");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -755,7 +1091,7 @@ status(sqlite3 *db)
 	r = sqlite3_step(stmt);
 	if (r != SQLITE_ROW)
 	{
-		sqlite_print_error(db, "status.step.tomorrow");
+		sqlite_print_error(cache->db, "status.step.tomorrow");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -765,7 +1101,7 @@ status(sqlite3 *db)
 	r = sqlite3_reset(stmt);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "status.reset.tomorrow");
+		sqlite_print_error(cache->db, "status.reset.tomorrow");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -773,7 +1109,7 @@ status(sqlite3 *db)
 	r = sqlite3_bind_int64(stmt, 1, three_days);
 	if (r != SQLITE_OK)
 	{
-		sqlite_print_error(db, "status.bind.three_days");
+		sqlite_print_error(cache->db, "status.bind.three_days");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -781,7 +1117,7 @@ status(sqlite3 *db)
 	r = sqlite3_step(stmt);
 	if (r != SQLITE_ROW)
 	{
-		sqlite_print_error(db, "status.step.three_days");
+		sqlite_print_error(cache->db, "status.step.three_days");
 		r = YSARYS_E;
 		goto _done;
 	}
@@ -790,13 +1126,43 @@ status(sqlite3 *db)
 
 	fprintf(stdout, "%d\t%d\n", count_tomorrow, count_three_days);
 
+	db_stmt_cache_release(stmt);
+	stmt = NULL;
+
+	/* So the next prompt takes the fast path. */
+	r = status_snapshot(cache, now);
+	if (r != YSARYS_OK)
+		goto _done;
+
 	r = YSARYS_OK;
 _done:
 	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+		db_stmt_cache_release(stmt);
 	return r;
 }
 
+/* Answers status from the snapshot saved by the last run, without opening
+ * the database. Shell prompts call status all the time. */
+static int
+status_fast(const char *db_filename)
+{
+	struct status_file snapshot;
+	time_t now = 0;
+
+	now = time(NULL);
+	if (now == ((time_t)-1))
+		return YSARYS_E;
+
+	if (status_file_read(db_filename, now, now + (3 * SECS_PER_DAY),
+	                     &snapshot) != STATUS_FILE_OK)
+		return YSARYS_E;
+
+	fprintf(stdout, "%d\t%d\n",
+	        (int)status_file_count(&snapshot, now + SECS_PER_DAY),
+	        (int)status_file_count(&snapshot, now + (3 * SECS_PER_DAY)));
+	return YSARYS_OK;
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -804,6 +1170,7 @@ main(int argc, const char *argv[])
 	const char *command = NULL;
 	const char *sub_command = NULL;
 	sqlite3 *db = NULL;
+	struct db_stmt_cache cache = DB_STMT_CACHE_ZERO;
 	int r = 0;
 	int argi = 0;
 
@@ -818,6 +1185,13 @@ main(int argc, const char *argv[])
 	db_filename = argv[argi++];
 	command = argi < argc ? argv[argi++] : "run";
 
+	if (strcmp("status", command) == 0 &&
+	    status_fast(db_filename) == YSARYS_OK)
+	{
+		r = YSARYS_OK;
+		goto _done;
+	}
+
 	r = sqlite3_open(db_filename, &db);
 	if (r != SQLITE_OK)
 	{
@@ -841,40 +1215,42 @@ main(int argc, const char *argv[])
 		goto _done;
 	}
 
+	db_stmt_cache_init(&cache, db);
+
 	if (strcmp("run", command) == 0)
-		r = run(db, 0);
+		r = run(&cache, 0);
 	else if (strcmp("recheck", command) == 0)
-		r = run(db, 1);
+		r = run(&cache, 1);
 	else if (strcmp("status", command) == 0)
-		r = status(db);
+		r = status(&cache);
 	else if (strcmp("scheduler", command) == 0)
 	{
 		sub_command = argi < argc ? argv[argi++] : "list";
 		if (strcmp("list", sub_command) == 0)
-			r = scheduler_list(db);
+			r = scheduler_list(&cache);
 		else if (strcmp("rm", sub_command) == 0)
-			r = scheduler_rm(db, argc - argi, &argv[argi]);
+			r = scheduler_rm(&cache, argc - argi, &argv[argi]);
 		else if (strcmp("add", sub_command) == 0)
 		{
-			r = scheduler_add(db, argc - argi, &argv[argi]);
+			r = scheduler_add(&cache, argc - argi, &argv[argi]);
 			if (r != YSARYS_OK)
 				goto _done;
-			r = run(db, 1);
+			r = run(&cache, 1);
 		}
 	}
 	else if (strcmp("agenda", command) == 0)
 	{
 		sub_command = argi < argc ? argv[argi++] : "list";
 		if (strcmp("list", sub_command) == 0)
-			r = agenda_list(db);
+			r = agenda_list(&cache);
 		else if (strcmp("rm", sub_command) == 0)
-			r = agenda_rm(db, argc - argi, &argv[argi]);
+			r = agenda_rm(&cache, argc - argi, &argv[argi]);
 		else if (strcmp("add", sub_command) == 0)
 		{
-			r = agenda_add(db, argc - argi, &argv[argi]);
+			r = agenda_add(&cache, argc - argi, &argv[argi]);
 			if (r != YSARYS_OK)
 				goto _done;
-			r = run(db, 1);
+			r = run(&cache, 1);
 		}
 	}
 	else
@@ -885,6 +1261,13 @@ main(int argc, const char *argv[])
 	}
 
 _done:
+	if (db != NULL)
+	{
+		log_debug("Statements prepared: %lu, reused: %lu.",
+		          (unsigned long)cache.prepare_count,
+		          (unsigned long)cache.reuse_count);
+		db_stmt_cache_finalize(&cache);
+	}
 	if (db != NULL && sqlite3_close(db) != SQLITE_OK)
 	{
 		sqlite_print_error(db, "sqlite3_close");
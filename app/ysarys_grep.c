@@ -0,0 +1,261 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/agenda.h"
+#include "../lib/date.h"
+#include "../lib/log.h"
+#include "../lib/scan.h"
+#include "../lib/str.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* grep(1) exit codes. */
+enum
+{
+	GREP_MATCH = 0,
+	GREP_NO_MATCH,
+	GREP_E
+};
+
+struct filter
+{
+	const char *tag;
+	size_t tag_count;
+	daynum from;
+	daynum until;
+};
+
+void
+usage(const char *command)
+{
+	fprintf(stderr,
+	        "Usage: %s [-t tag] [-f YYYY-MM-DD] [-u YYYY-MM-DD] "
+	        "[file ...]\n"
+	        "Prints agenda entries matching all filters. Reads stdin when "
+	        "no file is given or file is \"-\".\n",
+	        command);
+}
+
+static int
+filter_matches(struct filter *filter, struct agenda_entry *entry)
+{
+	if (entry->day < filter->from || entry->day > filter->until)
+		return 0;
+	if (filter->tag != NULL &&
+	    !agenda_entry_has_tag(entry, filter->tag, filter->tag_count))
+		return 0;
+	return 1;
+}
+
+static void
+entry_print(struct agenda_entry *entry)
+{
+	struct agenda_entry tagged = AGENDA_ENTRY_ZERO;
+
+	daynum_fprintf(stdout, entry->day);
+	fputc('\t', stdout);
+	str_print(stdout, entry->tag_csv);
+
+	/* Done records show as the tag compacting the file folds them into. */
+	tagged = *entry;
+	tagged.done = 0;
+	if (entry->done && !agenda_entry_has_tag(&tagged, "done", 4))
+		fputs(entry->tag_csv->count > 0 ? ",done" : "done", stdout);
+
+	fputc('\t', stdout);
+	str_print(stdout, entry->title);
+	fputc('\n', stdout);
+}
+
+/* Reports an agenda error, always E. */
+static int
+grep_error(int agenda_r, const char *path, int errno_)
+{
+	switch (agenda_r)
+	{
+		case AGENDA_EOOM:
+			log_error("Out of memory.");
+			break;
+
+		case AGENDA_EACCES:
+			log_error("Permission error trying to read: %s.", path);
+			break;
+
+		case AGENDA_ENOENT:
+			log_error("File not found: %s.", path);
+			break;
+
+		case AGENDA_EERRNO:
+			errno = errno_;
+			log_error("IO error trying to read: %s.", path);
+			perror("grep");
+			break;
+
+		case AGENDA_EINVALHEAD:
+			log_error("Invalid file format. Invalid header: %s.",
+			          path);
+			break;
+
+		default:
+			log_error("Invalid file format. Invalid entry: %s.",
+			          path);
+			break;
+	}
+
+	return GREP_E;
+}
+
+/* MATCH | NO_MATCH | E. Date filtered reads of a file go through its index,
+ * only the lines in range are parsed. */
+static int
+grep_range(const char *path, struct filter *filter)
+{
+	struct agenda_file *file = NULL;
+	size_t i = 0;
+	int matched = 0;
+	int errno_ = 0;
+	int r = 0;
+
+	r = agenda_file_range_alloc(path, filter->from, filter->until, &file,
+	                            &errno_);
+	if (r != AGENDA_OK)
+		return grep_error(r, path, errno_);
+
+	for (i = 0; i < file->entry_count; i++)
+	{
+		if (!filter_matches(filter, &file->entry_array[i]))
+			continue;
+
+		matched = 1;
+		entry_print(&file->entry_array[i]);
+	}
+
+	agenda_file_free(file);
+	return matched ? GREP_MATCH : GREP_NO_MATCH;
+}
+
+/* MATCH | NO_MATCH | E */
+static int
+grep(const char *path, struct filter *filter)
+{
+	struct agenda_iter *iter = NULL;
+	struct agenda_entry entry = AGENDA_ENTRY_ZERO;
+	int matched = 0;
+	int errno_ = 0;
+	int r = 0;
+
+	if (strcmp("-", path) == 0)
+		r = agenda_iter_fd_alloc(stdin, &iter);
+	else if (filter->from != DAYNUM_MIN || filter->until != DAYNUM_MAX)
+		return grep_range(path, filter);
+	else
+		r = agenda_iter_open_alloc(path, &iter, &errno_);
+
+	/* A pipe can't be read twice, its entries only have the done tag they
+	 * were written with. */
+	if (r == AGENDA_OK && ftell(iter->fd) >= 0)
+		r = agenda_iter_done_load(iter, &errno_);
+
+	while (r == AGENDA_OK)
+	{
+		r = agenda_iter_next(iter, &entry, &errno_);
+		if (r != AGENDA_OK || !filter_matches(filter, &entry))
+			continue;
+
+		matched = 1;
+		entry_print(&entry);
+	}
+
+	if (r == AGENDA_OK_DONE)
+		r = matched ? GREP_MATCH : GREP_NO_MATCH;
+	else
+		r = grep_error(r, path, errno_);
+
+	if (iter != NULL)
+		agenda_iter_close(iter);
+	return r;
+}
+
+int
+main(int argc, const char *argv[])
+{
+	struct filter filter = { NULL, 0, DAYNUM_MIN, DAYNUM_MAX };
+	struct date date = DATE_ZERO;
+	daynum *day = NULL;
+	int argi = 1;
+	int r = GREP_NO_MATCH;
+	int file_r = 0;
+
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0';
+	     argi++)
+	{
+		if (strcmp("--", argv[argi]) == 0)
+		{
+			argi++;
+			break;
+		}
+
+		if (argi + 1 >= argc || argv[argi][2] != '\0')
+		{
+			usage(argv[0]);
+			return GREP_E;
+		}
+
+		switch (argv[argi][1])
+		{
+			case 't':
+				filter.tag = argv[++argi];
+				filter.tag_count = strlen(filter.tag);
+				continue;
+
+			case 'f':
+				day = &filter.from;
+				break;
+
+			case 'u':
+				day = &filter.until;
+				break;
+
+			default:
+				usage(argv[0]);
+				return GREP_E;
+		}
+
+		argi++;
+		if (scan_date(argv[argi], strlen(argv[argi]), &date) != SCAN_OK)
+		{
+			log_error("Invalid date: %s.", argv[argi]);
+			return GREP_E;
+		}
+		*day = daynum_from_date(&date);
+	}
+
+	if (argi == argc)
+		return grep("-", &filter);
+
+	for (; argi < argc; argi++)
+	{
+		file_r = grep(argv[argi], &filter);
+		if (file_r == GREP_E)
+			return GREP_E;
+		if (file_r == GREP_MATCH)
+			r = GREP_MATCH;
+	}
+
+	return r;
+}
@@ -16,17 +16,46 @@
  */
 
 #include "../lib/agenda.h"
+#include "../lib/agenda_dedup.h"
 #include "../lib/date.h"
 #include "../lib/dir.h"
+#include "../lib/intern.h"
 #include "../lib/log.h"
 #include "../lib/rule_lua.h"
+#include "../lib/scan.h"
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 
 void
 usage(const char *command)
 {
-	printf("Usage: %s file\n", command);
+	printf("Usage: %s file [compact | done YYYY-MM-DD tag]\n", command);
+}
+
+int
+done(const char *path, const char *date_arg, const char *tag_arg)
+{
+	struct date date = DATE_ZERO;
+	struct str tag = { 0, NULL };
+	int errno_ = 0;
+
+	if (scan_date(date_arg, strlen(date_arg), &date) != SCAN_OK)
+	{
+		log_error("Invalid date: %s.", date_arg);
+		return -1;
+	}
+
+	tag.array = (char *)tag_arg;
+	tag.count = strlen(tag_arg);
+	if (agenda_file_append_done(path, daynum_from_date(&date), &tag,
+	                            AGENDA_WRITE_SYNC, &errno_) != AGENDA_OK)
+	{
+		fprintf(stderr, "agenda_file_append_done");
+		return -1;
+	}
+
+	return 0;
 }
 
 int
@@ -34,14 +63,19 @@ main(int argc, char *argv[])
 {
 	struct agenda_file *agenda = NULL;
 	struct agenda_array *array = NULL;
+	struct intern *intern = NULL;
+	struct agenda_dedup *dedup = NULL;
 	struct rule *rule = NULL;
-	struct weekdate date = WEEKDATE_ZERO;
-	struct weekdate today = WEEKDATE_ZERO;
-	struct weekdate max_date = WEEKDATE_ZERO;
+	struct date max_date = DATE_ZERO;
+	struct calendar cal = CALENDAR_ZERO;
+	daynum day = 0;
+	daynum today = 0;
+	daynum max_day = 0;
 	const char *lua_error_str = NULL;
 	dir_handle *rules_dir = NULL;
 	struct file_entry rule_file = FILE_ENTRY_ZERO;
 	time_t now = 0;
+	size_t existing_count = 0;
 	size_t i = 0;
 	int r = 0;
 	int errno_ = 0;
@@ -52,15 +86,46 @@ main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (argc == 3 && strcmp("compact", argv[2]) == 0)
+	{
+		if (agenda_file_compact(argv[1], AGENDA_WRITE_SYNC, &errno_) !=
+		    AGENDA_OK)
+		{
+			fprintf(stderr, "agenda_file_compact");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (argc == 5 && strcmp("done", argv[2]) == 0)
+		return done(argv[1], argv[3], argv[4]);
+
+	if (argc != 2)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	/* Rules generate the same titles and tags over and over, the agenda
+	 * and the rule output share one copy of each. */
+	if (intern_alloc(&intern) != INTERN_OK ||
+	    agenda_dedup_alloc(intern, &dedup) != AGENDA_DEDUP_OK)
+	{
+		log_error("Out of memory.");
+		return -1;
+	}
+
 	r = agenda_array_alloc(1, &array);
 	if (r == AGENDA_OK)
-		r = agenda_file_read_alloc(argv[1], &agenda, &errno_);
-	for (i = 0; r == AGENDA_OK && i < agenda->entry_count; i++)
 	{
-		r = agenda_array_push_alloc(array, &agenda->entry_array[i].date,
-		                            &agenda->entry_array[i].title,
-		                            &agenda->entry_array[i].tag_csv);
+		array->intern = intern;
+		array->dedup = dedup;
+		r = agenda_file_read_intern_alloc(argv[1], intern, &agenda,
+		                                  &errno_);
 	}
+	for (i = 0; r == AGENDA_OK && i < agenda->entry_count; i++)
+		r = agenda_array_push_entry_alloc(array,
+		                                  &agenda->entry_array[i]);
 
 	switch (r)
 	{
@@ -100,16 +165,17 @@ main(int argc, char *argv[])
 		log_error("Can't query current time.");
 		return -1;
 	}
-	weekdate_from_time(now, &today);
-	weekdate_add_days(&today, 60, &max_date);
-
-	if (agenda->last_run.day == 0)
-		weekdate_from_time(now, &date);
-	else
-	{
-		weekdate_from_date(&agenda->last_run, &date);
-		weekdate_next(&date);
-	}
+	today = daynum_from_time(now);
+	max_day = today + 60;
+	daynum_to_date(max_day, &max_date);
+
+	/* Dedup makes going over days already done harmless, so start from
+	 * today even when the last run went further. last_run itself is
+	 * where the last run stopped, before running it. */
+	day = today;
+	if (agenda->last_run.day != 0 &&
+	    daynum_from_date(&agenda->last_run) < today)
+		day = daynum_from_date(&agenda->last_run);
 
 	rule_lua_alloc(&rule);
 
@@ -196,10 +262,10 @@ main(int argc, char *argv[])
 		return -1;
 	}
 
-	for (; date_compare((struct date *)&date, (struct date *)&max_date) < 0;
-	     weekdate_next(&date))
+	existing_count = array->count;
+	for (calendar_init(&cal, day); cal.day < max_day; calendar_next(&cal))
 	{
-		r = rule_run(rule, &date, array, NULL, NULL);
+		r = rule_run(rule, &cal, array, NULL, NULL);
 		if (r != RULE_OK)
 		{
 			log_error("Rule error.");
@@ -207,39 +273,55 @@ main(int argc, char *argv[])
 		}
 	}
 
-	agenda_entry_sort(array->array, array->count);
+	/* Only what this run generated is written, the rest is on disk. */
+	r = agenda_file_append(argv[1], &max_date,
+	                       &array->array[existing_count],
+	                       array->count - existing_count, AGENDA_WRITE_SYNC,
+	                       &errno_);
+	if (r != AGENDA_OK)
+	{
+		fprintf(stderr, "agenda_file_append");
+		return -1;
+	}
 
-	for (i = 0; i < array->count; i++)
+	if (agenda->journal_count + 1 >= AGENDA_JOURNAL_COMPACT_THRESHOLD)
 	{
-		date_fprintf(stdout, &array->array[i].date);
-		fprintf(stdout, "\t");
-		str_print(stdout, array->array[i].title);
-		fprintf(stdout, "\t");
-		str_print(stdout, array->array[i].tag_csv);
-		fprintf(stdout, "\n");
+		r = agenda_file_compact(argv[1], AGENDA_WRITE_SYNC, &errno_);
+		if (r != AGENDA_OK)
+		{
+			fprintf(stderr, "agenda_file_compact");
+			return -1;
+		}
 	}
 
-	r = agenda_file_array_set_alloc(agenda, array);
+	/* Rules run day by day, so what they pushed is sorted already. */
+	if (agenda->sorted)
+		r = agenda_entry_merge(array->array, existing_count,
+		                       array->count);
+	else
+		r = agenda_entry_sort(array->array, array->count);
 	if (r != AGENDA_OK)
 	{
-		fprintf(stderr, "agenda_file_array_set_alloc");
+		log_error("Out of memory.");
 		return -1;
 	}
 
-	agenda->last_run.day = max_date.day;
-	agenda->last_run.month = max_date.month;
-	agenda->last_run.year = max_date.year;
-	r = agenda_file_write(argv[1], agenda, &errno_);
-	if (r != AGENDA_OK)
+	for (i = 0; i < array->count; i++)
 	{
-		fprintf(stderr, "agenda_file_write");
-		return -1;
+		daynum_fprintf(stdout, array->array[i].day);
+		fprintf(stdout, "\t");
+		str_print(stdout, array->array[i].title);
+		fprintf(stdout, "\t");
+		str_print(stdout, array->array[i].tag_csv);
+		fprintf(stdout, "\n");
 	}
 
 	rule_lua_free(rule);
 	dir_close(rules_dir);
 	agenda_array_free(array);
 	agenda_file_free(agenda);
+	agenda_dedup_free(dedup);
+	intern_free(intern);
 
 	return 0;
 }
@@ -28,7 +28,7 @@ main(void)
 	int r = 0;
 
 	printf("read\n");
-	r = agenda_file_read_alloc("agenda.txt", &agenda, NULL);
+	r = agenda_file_map_parallel_alloc("agenda.txt", 0, &agenda, NULL);
 	if (r != AGENDA_OK)
 	{
 		perror("read");
@@ -39,7 +39,7 @@ main(void)
 	agenda_entry_sort(agenda->entry_array, agenda->entry_count);
 
 	printf("write\n");
-	r = agenda_file_write("agenda_out.txt", agenda, NULL);
+	r = agenda_file_write("agenda_out.txt", agenda, 0, NULL);
 	if (r != AGENDA_OK)
 	{
 		perror("write");
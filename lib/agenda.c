@@ -16,8 +16,12 @@
  */
 
 #include "agenda.h"
+#include "agenda_index.h"
 #include "date.h"
+#include "fs.h"
+#include "memscan.h"
 #include "scan.h"
+#include "thread.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,7 +31,59 @@ _entry_compare(const void *a, const void *b)
 {
 	const struct agenda_entry *left = a;
 	const struct agenda_entry *right = b;
-	return date_compare(&left->date, &right->date);
+	return (left->day > right->day) - (left->day < right->day);
+}
+
+/* Sort key of an entry, in date order: the day with its sign bit flipped. */
+static u32
+_entry_key(struct agenda_entry *entry)
+{
+	return (u32)entry->day ^ 0x80000000u;
+}
+
+/* Scans a YYYY-MM-DD date. */
+static int
+_scan_day(const char *array, daynum *ret_day)
+{
+	struct date date = DATE_ZERO;
+
+	if (scan_date(array, 10, &date) != SCAN_OK)
+		return SCAN_EINVAL;
+	*ret_day = daynum_from_date(&date);
+	return SCAN_OK;
+}
+
+static int
+_entry_array_sorted(struct agenda_entry *array, size_t count)
+{
+	size_t i = 0;
+
+	for (i = 1; i < count; i++)
+		if (_entry_key(&array[i]) < _entry_key(&array[i - 1]))
+			return 0;
+	return 1;
+}
+
+static int
+_fs_error(int fs_r)
+{
+	switch (fs_r)
+	{
+		case FS_OK:
+			return AGENDA_OK;
+
+		case FS_EOOM:
+			return AGENDA_EOOM;
+
+		case FS_EACCES:
+			return AGENDA_EACCES;
+
+		case FS_ENOENT:
+			return AGENDA_ENOENT;
+
+		default:
+			return AGENDA_EERRNO;
+	}
 }
 
 static int
@@ -68,252 +124,1803 @@ _file_read_alloc(const char *path, char **ret_buffer, size_t *ret_count,
 		goto _done;
 	}
 
-	file_size = ftell(fd);
+	file_size = ftell(fd);
+
+	buffer = malloc(file_size);
+	if (buffer == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+
+	if (fseek(fd, 0, SEEK_SET) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	if (fread(buffer, 1, file_size, fd) != file_size)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+	{
+		*ret_buffer = buffer;
+		*ret_count = file_size;
+	}
+	else if (buffer != NULL)
+		free(buffer);
+	if (fd != NULL)
+		fclose(fd);
+	return r;
+}
+
+static size_t
+_buffer_entry_count(const char *buffer, size_t buffer_count)
+{
+	size_t entry_count = 0;
+	size_t i = 0;
+
+	for (i = 0; i < buffer_count; i++)
+	{
+		if (buffer[i] != '#')
+			entry_count++;
+		i += memscan_byte(&buffer[i], buffer_count - i, '\n');
+	}
+
+	return entry_count;
+}
+
+/* When `with_slices` is set, entries don't own their strings, they point into a
+ * single `slice_array` that is filled by `_buffer_parse`. */
+static int
+_file_alloc(size_t entry_count, int with_slices, struct agenda_file **ret_file)
+{
+	struct agenda_file *file = NULL;
+	size_t i = 0;
+	int r = 0;
+
+	file = malloc(sizeof *file);
+	if (file == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	file->last_run.day = 0;
+	file->last_run.month = 0;
+	file->last_run.year = 0;
+	file->journal_count = 0;
+	file->slice_array = NULL;
+	file->map.array = NULL;
+	file->map.count = 0;
+	file->map.mtime = 0;
+	file->map.handle = NULL;
+	file->intern = NULL;
+	file->sorted = 1;
+
+	file->entry_count = entry_count;
+	file->entry_array = malloc(sizeof *file->entry_array * entry_count);
+	if (file->entry_array == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	for (i = 0; i < entry_count; i++)
+	{
+		file->entry_array[i].day = 0;
+		file->entry_array[i].title = NULL;
+		file->entry_array[i].tag_csv = NULL;
+		file->entry_array[i].done = 0;
+	}
+
+	if (with_slices)
+	{
+		/* Two slices per entry: tag_csv and title. */
+		file->slice_array =
+		    malloc(sizeof *file->slice_array * entry_count * 2);
+		if (file->slice_array == NULL)
+		{
+			r = AGENDA_EOOM;
+			goto _done;
+		}
+	}
+
+	r = AGENDA_OK;
+	*ret_file = file;
+_done:
+	if (r != AGENDA_OK && file != NULL)
+	{
+		if (file->entry_array != NULL)
+			free(file->entry_array);
+		free(file);
+	}
+	return r;
+}
+
+static int
+_entry_str_set(struct agenda_file *file, const char *array, size_t count,
+               size_t slice_index, struct str **ret_str)
+{
+	struct str *slice = NULL;
+
+	if (file->intern != NULL)
+	{
+		if (intern_put_str(file->intern, array, count, ret_str) !=
+		    INTERN_OK)
+			return AGENDA_EOOM;
+		return AGENDA_OK;
+	}
+
+	if (file->slice_array == NULL)
+	{
+		if (str_slice_alloc(array, count, ret_str) != STR_OK)
+			return AGENDA_EOOM;
+		return AGENDA_OK;
+	}
+
+	slice = &file->slice_array[slice_index];
+	slice->count = count;
+	slice->array = (char *)array;
+	*ret_str = slice;
+	return AGENDA_OK;
+}
+
+enum
+{
+	_LINE_ENTRY,
+	_LINE_LAST_RUN,
+	_LINE_DONE
+};
+
+/* Parses one line, without its '\n', and returns which kind it is through
+ * `ret_kind`. A last_run header updates `last_run`. An entry fills `ret_entry`
+ * date and the `ret_tag_csv` and `ret_title` slices, which point into `line`.
+ * A done record fills the date and `ret_tag_csv` with the tag it refers to. */
+static int
+_line_parse(const char *line, size_t count, struct date *last_run,
+            struct agenda_entry *ret_entry, struct str *ret_tag_csv,
+            struct str *ret_title, int *ret_kind)
+{
+	size_t i = 0;
+	size_t mark = 0;
+
+	if (count > 0 && line[0] == '#')
+	{
+		/* 29 = 19 for prefix + 10 for date */
+		if (count >= 29 &&
+		    strncmp(line, "# ysarys: last_run ", 19) == 0)
+		{
+			if (scan_date(&line[19], 10, last_run) != SCAN_OK)
+				return AGENDA_EINVALHEAD;
+			*ret_kind = _LINE_LAST_RUN;
+			return AGENDA_OK;
+		}
+
+		/* 26 = 15 for prefix + 10 for date + \t */
+		if (count >= 26 && strncmp(line, "# ysarys: done ", 15) == 0)
+		{
+			if (_scan_day(&line[15], &ret_entry->day) != SCAN_OK ||
+			    line[25] != '\t')
+				return AGENDA_EINVALHEAD;
+			ret_tag_csv->array = (char *)&line[26];
+			ret_tag_csv->count = count - 26;
+			*ret_kind = _LINE_DONE;
+			return AGENDA_OK;
+		}
+
+		return AGENDA_EINVALHEAD;
+	}
+
+	/* 11 = 10 for date + \t */
+	if (count < 11)
+		return AGENDA_EINVALENTRY;
+	if (_scan_day(line, &ret_entry->day) != SCAN_OK)
+		return AGENDA_EINVALENTRY;
+	if (line[10] != '\t')
+		return AGENDA_EINVALENTRY;
+
+	mark = 11;
+	i = mark + memscan_byte(&line[mark], count - mark, '\t');
+	ret_tag_csv->array = (char *)&line[mark];
+	ret_tag_csv->count = i - mark;
+
+	if (i < count)
+		i++;
+	ret_title->array = (char *)&line[i];
+	ret_title->count = count - i;
+
+	*ret_kind = _LINE_ENTRY;
+	return AGENDA_OK;
+}
+
+/* non-0 = `entry` is due at `day` and its first tag is `tag` */
+static int
+_entry_is(struct agenda_entry *entry, daynum day, struct str *tag)
+{
+	if (entry->day != day)
+		return 0;
+	if (entry->tag_csv->count < tag->count ||
+	    memcmp(entry->tag_csv->array, tag->array, tag->count) != 0)
+		return 0;
+	return entry->tag_csv->count == tag->count ||
+	       entry->tag_csv->array[tag->count] == ',';
+}
+
+/* Marks every entry before `end` that `done` refers to. */
+static void
+_entry_array_done(struct agenda_entry *array, size_t end,
+                  struct agenda_entry *done)
+{
+	size_t i = 0;
+
+	for (i = 0; i < end; i++)
+		if (_entry_is(&array[i], done->day, done->tag_csv))
+			array[i].done = 1;
+}
+
+/* A done record whose entries may come before `entry_end`. */
+struct _done
+{
+	daynum day;
+	struct str tag;
+	size_t entry_end;
+};
+
+/* State of parsing one buffer, or one chunk of it, into `file`. */
+struct _parse
+{
+	struct agenda_file *file;
+	/* With `from` and `to` set, only entries in that range are kept. */
+	daynum from;
+	daynum to;
+	size_t entry_i;
+	/* Cleared when an entry is found before the one preceding it. */
+	int sorted;
+	u32 key_last;
+	struct date last_run;
+	size_t last_run_count;
+	size_t done_count;
+	/* Chunks parsed in parallel don't see the entries of earlier chunks,
+	 * they keep their done records here to be replayed after the join. */
+	int defer_done;
+	size_t done_capacity;
+	struct _done *done_array;
+};
+
+static void
+_parse_init(struct _parse *parse, struct agenda_file *file, daynum from,
+            daynum to)
+{
+	parse->file = file;
+	parse->from = from;
+	parse->to = to;
+	parse->entry_i = 0;
+	parse->sorted = 1;
+	parse->key_last = 0;
+	parse->last_run.day = 0;
+	parse->last_run.month = 0;
+	parse->last_run.year = 0;
+	parse->last_run_count = 0;
+	parse->done_count = 0;
+	parse->defer_done = 0;
+	parse->done_capacity = 0;
+	parse->done_array = NULL;
+}
+
+static int
+_parse_defer_done(struct _parse *parse, daynum day, struct str *tag)
+{
+	struct _done *done_array = NULL;
+	size_t capacity = 0;
+
+	if (parse->done_count == parse->done_capacity)
+	{
+		capacity = parse->done_capacity == 0 ? 16
+		                                     : parse->done_capacity * 2;
+		done_array = realloc(parse->done_array,
+		                     sizeof *done_array * capacity);
+		if (done_array == NULL)
+			return AGENDA_EOOM;
+		parse->done_array = done_array;
+		parse->done_capacity = capacity;
+	}
+
+	parse->done_array[parse->done_count].day = day;
+	parse->done_array[parse->done_count].tag = *tag;
+	parse->done_array[parse->done_count].entry_end = parse->entry_i;
+	return AGENDA_OK;
+}
+
+/* Moves the headers seen by `parse` into its file. The base file has a single
+ * last_run, every append adds another one and maybe some done records. */
+static void
+_parse_finish(struct _parse *parse)
+{
+	struct agenda_file *file = parse->file;
+
+	if (parse->last_run_count > 0)
+		file->last_run = parse->last_run;
+	file->sorted = file->sorted && parse->sorted;
+	file->journal_count += parse->done_count;
+	if (parse->last_run_count > 1)
+		file->journal_count += parse->last_run_count - 1;
+	if (parse->done_array != NULL)
+		free(parse->done_array);
+	parse->done_array = NULL;
+}
+
+/* Parses entries into `parse->file` starting at `parse->entry_i`, which is
+ * moved past the last one. */
+static int
+_buffer_parse(const char *buffer, size_t buffer_count, struct _parse *parse)
+{
+	struct agenda_file *file = parse->file;
+	struct agenda_entry parsed = AGENDA_ENTRY_ZERO;
+	struct agenda_entry *entry = NULL;
+	struct str tag_csv = { 0, NULL };
+	struct str title = { 0, NULL };
+	size_t i = 0;
+	size_t mark = 0;
+	int kind = 0;
+	int r = 0;
+
+	for (mark = 0; mark < buffer_count; mark = i + 1)
+	{
+		i = mark +
+		    memscan_byte(&buffer[mark], buffer_count - mark, '\n');
+
+		r = _line_parse(&buffer[mark], i - mark, &parse->last_run,
+		                &parsed, &tag_csv, &title, &kind);
+		if (r != AGENDA_OK)
+			goto _done;
+
+		switch (kind)
+		{
+			case _LINE_LAST_RUN:
+				parse->last_run_count++;
+				continue;
+
+			case _LINE_DONE:
+				if (parse->defer_done)
+				{
+					r = _parse_defer_done(parse,
+					                      parsed.day,
+					                      &tag_csv);
+					if (r != AGENDA_OK)
+						goto _done;
+				}
+				else
+				{
+					parsed.tag_csv = &tag_csv;
+					_entry_array_done(file->entry_array,
+					                  parse->entry_i,
+					                  &parsed);
+				}
+				parse->done_count++;
+				continue;
+		}
+
+		if (parsed.day < parse->from || parsed.day > parse->to)
+			continue;
+
+		entry = &file->entry_array[parse->entry_i];
+		entry->day = parsed.day;
+		entry->done = 0;
+		if (_entry_key(entry) < parse->key_last)
+			parse->sorted = 0;
+		parse->key_last = _entry_key(entry);
+		r = _entry_str_set(file, tag_csv.array, tag_csv.count,
+		                   parse->entry_i * 2, &entry->tag_csv);
+		if (r != AGENDA_OK)
+			goto _done;
+		r = _entry_str_set(file, title.array, title.count,
+		                   parse->entry_i * 2 + 1, &entry->title);
+		if (r != AGENDA_OK)
+			goto _done;
+		parse->entry_i++;
+	}
+
+	r = AGENDA_OK;
+_done:
+	return r;
+}
+
+static int
+_read_alloc(const char *path, struct intern *intern,
+            struct agenda_file **ret_file, int *reterr_errno)
+{
+	struct _parse parse;
+	char *buffer = NULL;
+	struct agenda_file *file = NULL;
+	size_t buffer_count = 0;
+	int r = 0;
+
+	r = _file_read_alloc(path, &buffer, &buffer_count, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = _file_alloc(_buffer_entry_count(buffer, buffer_count), 0, &file);
+	if (r != AGENDA_OK)
+		goto _done;
+	file->intern = intern;
+
+	_parse_init(&parse, file, DAYNUM_MIN, DAYNUM_MAX);
+	r = _buffer_parse(buffer, buffer_count, &parse);
+	_parse_finish(&parse);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+		*ret_file = file;
+	else if (file != NULL)
+		agenda_file_free(file);
+	if (buffer != NULL)
+		free(buffer);
+	return r;
+}
+
+int
+agenda_file_read_alloc(const char *path, struct agenda_file **ret_file,
+                       int *reterr_errno)
+{
+	return _read_alloc(path, NULL, ret_file, reterr_errno);
+}
+
+int
+agenda_file_read_intern_alloc(const char *path, struct intern *intern,
+                              struct agenda_file **ret_file,
+                              int *reterr_errno)
+{
+	return _read_alloc(path, intern, ret_file, reterr_errno);
+}
+
+int
+agenda_file_map_alloc(const char *path, struct agenda_file **ret_file,
+                      int *reterr_errno)
+{
+	struct _parse parse;
+	struct fs_map map = FS_MAP_ZERO;
+	struct agenda_file *file = NULL;
+	int r = 0;
+
+	r = _fs_error(fs_map(path, &map, reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = _file_alloc(_buffer_entry_count(map.array, map.count), 1, &file);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	/* From here on the file owns the mapping. */
+	file->map = map;
+	map.array = NULL;
+
+	_parse_init(&parse, file, DAYNUM_MIN, DAYNUM_MAX);
+	r = _buffer_parse(file->map.array, file->map.count, &parse);
+	_parse_finish(&parse);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+		*ret_file = file;
+	else if (file != NULL)
+		agenda_file_free(file);
+	if (map.array != NULL)
+		fs_unmap(&map);
+	return r;
+}
+
+/* Chunks smaller than this aren't worth a thread. */
+#define _PARALLEL_CHUNK_MIN (256 * 1024)
+#define _PARALLEL_THREAD_MAX 64
+
+struct _chunk
+{
+	const char *buffer;
+	size_t count;
+	size_t entry_count;
+	struct _parse parse;
+	int r;
+};
+
+static void
+_chunk_count(void *arg)
+{
+	struct _chunk *chunk = arg;
+
+	chunk->entry_count = _buffer_entry_count(chunk->buffer, chunk->count);
+}
+
+static void
+_chunk_parse(void *arg)
+{
+	struct _chunk *chunk = arg;
+
+	chunk->r = _buffer_parse(chunk->buffer, chunk->count, &chunk->parse);
+}
+
+/* Runs `fn` over every `size` bytes element of `array`, the calling thread
+ * takes the first one. Elements that can't get a thread run on the calling
+ * thread too. */
+static void
+_parallel_run(void (*fn)(void *arg), void *array, size_t size, size_t count)
+{
+	thread_handle *handle_array[_PARALLEL_THREAD_MAX];
+	char *element = array;
+	size_t started = 0;
+	size_t i = 0;
+
+	for (i = 1; i < count; i++)
+	{
+		if (thread_start(fn, &element[i * size], &handle_array[i]) !=
+		    THREAD_OK)
+			break;
+		started = i;
+	}
+
+	fn(element);
+	for (i = started + 1; i < count; i++)
+		fn(&element[i * size]);
+	for (i = 1; i <= started; i++)
+		thread_join(handle_array[i]);
+}
+
+/* Splits `buffer` in `chunk_count` parts of about the same size, each one
+ * ending right after a '\n' so no line is cut. */
+static void
+_chunk_split(const char *buffer, size_t count, struct _chunk *chunk_array,
+             size_t chunk_count)
+{
+	size_t start = 0;
+	size_t end = 0;
+	size_t i = 0;
+
+	for (i = 0; i < chunk_count; i++)
+	{
+		end = i + 1 == chunk_count ? count
+		                            : count / chunk_count * (i + 1);
+		if (end < start)
+			end = start;
+		while (end > 0 && end < count && buffer[end - 1] != '\n')
+			end++;
+		chunk_array[i].buffer = &buffer[start];
+		chunk_array[i].count = end - start;
+		chunk_array[i].entry_count = 0;
+		chunk_array[i].r = AGENDA_OK;
+		start = end;
+	}
+}
+
+int
+agenda_file_map_parallel_alloc(const char *path, int thread_count,
+                               struct agenda_file **ret_file,
+                               int *reterr_errno)
+{
+	struct _chunk chunk_array[_PARALLEL_THREAD_MAX];
+	struct fs_map map = FS_MAP_ZERO;
+	struct agenda_file *file = NULL;
+	struct _parse merged;
+	struct _parse *parse = NULL;
+	struct agenda_entry done = AGENDA_ENTRY_ZERO;
+	size_t chunk_count = 0;
+	size_t entry_count = 0;
+	size_t i = 0;
+	size_t j = 0;
+	int r = 0;
+
+	r = _fs_error(fs_map(path, &map, reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	if (thread_count <= 0)
+		thread_count = thread_cpu_count();
+	chunk_count = map.count / _PARALLEL_CHUNK_MIN + 1;
+	if (chunk_count > (size_t)thread_count)
+		chunk_count = thread_count;
+	if (chunk_count > _PARALLEL_THREAD_MAX)
+		chunk_count = _PARALLEL_THREAD_MAX;
+
+	_chunk_split(map.array, map.count, chunk_array, chunk_count);
+	_parallel_run(_chunk_count, chunk_array, sizeof *chunk_array,
+	              chunk_count);
+	for (i = 0; i < chunk_count; i++)
+		entry_count += chunk_array[i].entry_count;
+
+	r = _file_alloc(entry_count, 1, &file);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	file->map = map;
+	map.array = NULL;
+
+	/* Each chunk fills its own part of the entry array. */
+	entry_count = 0;
+	for (i = 0; i < chunk_count; i++)
+	{
+		_parse_init(&chunk_array[i].parse, file, DAYNUM_MIN,
+		            DAYNUM_MAX);
+		chunk_array[i].parse.entry_i = entry_count;
+		chunk_array[i].parse.defer_done = 1;
+		entry_count += chunk_array[i].entry_count;
+	}
+	_parallel_run(_chunk_parse, chunk_array, sizeof *chunk_array,
+	              chunk_count);
+
+	/* Headers and done records are applied in file order, the last
+	 * last_run wins. */
+	r = AGENDA_OK;
+	_parse_init(&merged, file, DAYNUM_MIN, DAYNUM_MAX);
+	entry_count = 0;
+	for (i = 0; i < chunk_count; i++)
+	{
+		parse = &chunk_array[i].parse;
+		if (r == AGENDA_OK)
+			r = chunk_array[i].r;
+		for (j = 0; r == AGENDA_OK && j < parse->done_count; j++)
+		{
+			done.day = parse->done_array[j].day;
+			done.tag_csv = &parse->done_array[j].tag;
+			_entry_array_done(file->entry_array,
+			                  parse->done_array[j].entry_end,
+			                  &done);
+		}
+		if (parse->last_run_count > 0)
+			merged.last_run = parse->last_run;
+		/* Each chunk only checked its own entries. */
+		merged.sorted = merged.sorted && parse->sorted;
+		if (chunk_array[i].entry_count > 0 &&
+		    _entry_key(&file->entry_array[entry_count]) <
+		        merged.key_last)
+			merged.sorted = 0;
+		if (chunk_array[i].entry_count > 0)
+			merged.key_last = parse->key_last;
+		entry_count += chunk_array[i].entry_count;
+		merged.last_run_count += parse->last_run_count;
+		merged.done_count += parse->done_count;
+		if (parse->done_array != NULL)
+			free(parse->done_array);
+	}
+	_parse_finish(&merged);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+		*ret_file = file;
+	else if (file != NULL)
+		agenda_file_free(file);
+	if (map.array != NULL)
+		fs_unmap(&map);
+	return r;
+}
+
+int
+agenda_file_range_alloc(const char *path, daynum from, daynum to,
+                        struct agenda_file **ret_file, int *reterr_errno)
+{
+	struct _parse parse;
+	struct fs_map map = FS_MAP_ZERO;
+	struct agenda_index *index = NULL;
+	struct agenda_file *file = NULL;
+	const char *buffer = NULL;
+	size_t head_end = 0;
+	size_t start = 0;
+	size_t end = 0;
+	int r = 0;
+
+	r = _fs_error(fs_map(path, &map, reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = agenda_index_load_alloc(path, &map, &index);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	agenda_index_find(index, from, to, &start, &end);
+	head_end = index->day_count > 0 ? index->day_array[0].offset
+	                                : index->sorted_end;
+
+	/* Headers before the first entry, the entries in range and whatever
+	 * isn't sorted yet, e.g. the journal. */
+	buffer = map.array;
+	r = _file_alloc(_buffer_entry_count(&buffer[start], end - start) +
+	                    _buffer_entry_count(&buffer[index->sorted_end],
+	                                        map.count - index->sorted_end),
+	                1, &file);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	file->map = map;
+	map.array = NULL;
+
+	_parse_init(&parse, file, from, to);
+	r = _buffer_parse(buffer, head_end, &parse);
+	if (r == AGENDA_OK)
+		r = _buffer_parse(&buffer[start], end - start, &parse);
+	if (r == AGENDA_OK)
+		r = _buffer_parse(&buffer[index->sorted_end],
+		                  file->map.count - index->sorted_end, &parse);
+	_parse_finish(&parse);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	file->entry_count = parse.entry_i;
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+		*ret_file = file;
+	else if (file != NULL)
+		agenda_file_free(file);
+	if (map.array != NULL)
+		fs_unmap(&map);
+	if (index != NULL)
+		agenda_index_free(index);
+	return r;
+}
+
+int
+agenda_iter_fd_alloc(FILE *fd, struct agenda_iter **ret_iter)
+{
+	struct agenda_iter *iter = NULL;
+	int r = 0;
+
+	iter = malloc(sizeof *iter);
+	if (iter == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	iter->fd = fd;
+	iter->owns_fd = 0;
+	iter->eof = 0;
+	iter->count = 0;
+	iter->offset = 0;
+	iter->last_run.day = 0;
+	iter->last_run.month = 0;
+	iter->last_run.year = 0;
+	iter->title.count = 0;
+	iter->title.array = NULL;
+	iter->tag_csv.count = 0;
+	iter->tag_csv.array = NULL;
+	iter->done_intern = NULL;
+	iter->done = NULL;
+
+	iter->buffer = malloc(AGENDA_ITER_BUFFER_SIZE);
+	if (iter->buffer == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+
+	r = AGENDA_OK;
+	*ret_iter = iter;
+_done:
+	if (r != AGENDA_OK && iter != NULL)
+		free(iter);
+	return r;
+}
+
+int
+agenda_iter_open_alloc(const char *path, struct agenda_iter **ret_iter,
+                       int *reterr_errno)
+{
+	FILE *fd = NULL;
+	int r = 0;
+
+	fd = fopen(path, "rb");
+	if (fd == NULL)
+	{
+		switch (errno)
+		{
+			case EACCES:
+				r = AGENDA_EACCES;
+				goto _done;
+
+			case ENOENT:
+				r = AGENDA_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				r = AGENDA_EERRNO;
+				goto _done;
+		}
+	}
+
+	r = agenda_iter_fd_alloc(fd, ret_iter);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	(*ret_iter)->owns_fd = 1;
+	fd = NULL;
+
+	r = AGENDA_OK;
+_done:
+	if (fd != NULL)
+		fclose(fd);
+	return r;
+}
+
+/* OK | OK_DONE | error. Points `ret_line` at the next line in the buffer of
+ * `iter`, refilling it as needed. */
+static int
+_iter_line(struct agenda_iter *iter, const char **ret_line,
+           size_t *ret_line_count, int *reterr_errno)
+{
+	size_t read_count = 0;
+	size_t i = 0;
+
+	for (;;)
+	{
+		i = iter->offset + memscan_byte(&iter->buffer[iter->offset],
+		                                iter->count - iter->offset,
+		                                '\n');
+
+		if (i == iter->count && !iter->eof)
+		{
+			/* Incomplete line: keep what is left and refill. */
+			iter->count -= iter->offset;
+			memmove(iter->buffer, &iter->buffer[iter->offset],
+			        iter->count);
+			iter->offset = 0;
+			if (iter->count == AGENDA_ITER_BUFFER_SIZE)
+				return AGENDA_EINVALENTRY;
+
+			read_count = fread(&iter->buffer[iter->count], 1,
+			                   AGENDA_ITER_BUFFER_SIZE - iter->count,
+			                   iter->fd);
+			if (read_count == 0)
+			{
+				if (ferror(iter->fd))
+				{
+					if (reterr_errno != NULL)
+						*reterr_errno = errno;
+					return AGENDA_EERRNO;
+				}
+				iter->eof = 1;
+			}
+			iter->count += read_count;
+			continue;
+		}
+
+		if (iter->offset == iter->count)
+			return AGENDA_OK_DONE;
+
+		*ret_line = &iter->buffer[iter->offset];
+		*ret_line_count = i - iter->offset;
+		iter->offset = i < iter->count ? i + 1 : i;
+		return AGENDA_OK;
+	}
+}
+
+int
+agenda_iter_next(struct agenda_iter *iter, struct agenda_entry *ret_entry,
+                 int *reterr_errno)
+{
+	const char *line = NULL;
+	size_t line_count = 0;
+	int kind = 0;
+	int r = 0;
+
+	for (;;)
+	{
+		r = _iter_line(iter, &line, &line_count, reterr_errno);
+		if (r != AGENDA_OK)
+			goto _done;
+
+		r = _line_parse(line, line_count, &iter->last_run, ret_entry,
+		                &iter->tag_csv, &iter->title, &kind);
+		if (r != AGENDA_OK)
+			goto _done;
+
+		if (kind == _LINE_ENTRY)
+			break;
+	}
+
+	ret_entry->tag_csv = &iter->tag_csv;
+	ret_entry->title = &iter->title;
+	ret_entry->done = 0;
+	if (iter->done != NULL &&
+	    agenda_dedup_has(iter->done, ret_entry->day, &iter->tag_csv,
+	                     &ret_entry->done) != AGENDA_DEDUP_OK)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+
+	r = AGENDA_OK;
+_done:
+	return r;
+}
+
+int
+agenda_iter_done_load(struct agenda_iter *iter, int *reterr_errno)
+{
+	struct agenda_entry parsed = AGENDA_ENTRY_ZERO;
+	struct date last_run = DATE_ZERO;
+	struct str tag_csv = { 0, NULL };
+	struct str title = { 0, NULL };
+	const char *line = NULL;
+	size_t line_count = 0;
+	long start = 0;
+	int kind = 0;
+	int r = 0;
+
+	/* Where the next entry starts, before what is already buffered. */
+	start = ftell(iter->fd);
+	if (start < 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+	start -= (long)(iter->count - iter->offset);
+
+	if (iter->done == NULL)
+	{
+		if (intern_alloc(&iter->done_intern) != INTERN_OK ||
+		    agenda_dedup_alloc(iter->done_intern, &iter->done) !=
+		        AGENDA_DEDUP_OK)
+		{
+			r = AGENDA_EOOM;
+			goto _done;
+		}
+	}
+
+	while ((r = _iter_line(iter, &line, &line_count, reterr_errno)) ==
+	       AGENDA_OK)
+	{
+		r = _line_parse(line, line_count, &last_run, &parsed, &tag_csv,
+		                &title, &kind);
+		if (r != AGENDA_OK)
+			goto _done;
+
+		if (kind == _LINE_DONE &&
+		    agenda_dedup_put(iter->done, parsed.day, &tag_csv) !=
+		        AGENDA_DEDUP_OK)
+		{
+			r = AGENDA_EOOM;
+			goto _done;
+		}
+	}
+	if (r != AGENDA_OK_DONE)
+		goto _done;
+
+	if (fseek(iter->fd, start, SEEK_SET) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+	iter->eof = 0;
+	iter->count = 0;
+	iter->offset = 0;
+
+	r = AGENDA_OK;
+_done:
+	return r;
+}
+
+void
+agenda_iter_close(struct agenda_iter *iter)
+{
+	if (iter->owns_fd && iter->fd != NULL)
+		fclose(iter->fd);
+	if (iter->done != NULL)
+		agenda_dedup_free(iter->done);
+	if (iter->done_intern != NULL)
+		intern_free(iter->done_intern);
+	free(iter->buffer);
+	free(iter);
+}
+
+static int
+_tag_csv_has(struct str *tag_csv_str, const char *tag, size_t tag_count)
+{
+	const char *tag_csv = NULL;
+	size_t count = 0;
+	size_t mark = 0;
+	size_t i = 0;
+
+	tag_csv = tag_csv_str->array;
+	count = tag_csv_str->count;
+	for (mark = 0; mark <= count; mark = i + 1)
+	{
+		for (i = mark; i < count; i++)
+			if (tag_csv[i] == ',')
+				break;
+		if (i - mark == tag_count &&
+		    memcmp(&tag_csv[mark], tag, tag_count) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+int
+agenda_entry_has_tag(struct agenda_entry *entry, const char *tag,
+                     size_t tag_count)
+{
+	/* Done records from the journal haven't been folded into the tags. */
+	if (entry->done && tag_count == 4 && memcmp(tag, "done", 4) == 0)
+		return 1;
+
+	return _tag_csv_has(entry->tag_csv, tag, tag_count);
+}
+
+struct _writer
+{
+	FILE *fd;
+	char *buffer;
+	size_t count;
+};
+
+static int
+_writer_flush(struct _writer *writer, int *reterr_errno)
+{
+	if (writer->count == 0)
+		return AGENDA_OK;
+
+	if (fwrite(writer->buffer, 1, writer->count, writer->fd) !=
+	    writer->count)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		return AGENDA_EERRNO;
+	}
+
+	writer->count = 0;
+	return AGENDA_OK;
+}
+
+static int
+_writer_put(struct _writer *writer, const char *array, size_t count,
+            int *reterr_errno)
+{
+	int r = 0;
+
+	if (AGENDA_WRITE_BUFFER_SIZE - writer->count < count)
+	{
+		r = _writer_flush(writer, reterr_errno);
+		if (r != AGENDA_OK)
+			return r;
+
+		/* Too big to be buffered at all, write it as is. */
+		if (count >= AGENDA_WRITE_BUFFER_SIZE)
+		{
+			if (fwrite(array, 1, count, writer->fd) != count)
+			{
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				return AGENDA_EERRNO;
+			}
+			return AGENDA_OK;
+		}
+	}
+
+	memcpy(&writer->buffer[writer->count], array, count);
+	writer->count += count;
+	return AGENDA_OK;
+}
+
+static int
+_writer_header(struct _writer *writer, struct date *last_run,
+               int *reterr_errno)
+{
+	char line[19 + DATE_FORMAT_MAX + 1] = "# ysarys: last_run ";
+	int count = 19;
+
+	count += date_format(&line[count], last_run);
+	line[count++] = '\n';
+	return _writer_put(writer, line, count, reterr_errno);
+}
+
+static int
+_writer_entry(struct _writer *writer, struct agenda_entry *entry,
+              int *reterr_errno)
+{
+	char date[DATE_FORMAT_MAX + 1];
+	int count = 0;
+	int r = 0;
+
+	count = daynum_format(date, entry->day);
+	date[count++] = '\t';
+	r = _writer_put(writer, date, count, reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_put(writer, entry->tag_csv->array,
+		                entry->tag_csv->count, reterr_errno);
+	if (r == AGENDA_OK && entry->done &&
+	    !_tag_csv_has(entry->tag_csv, "done", 4))
+	{
+		if (entry->tag_csv->count == 0)
+			r = _writer_put(writer, "done", 4, reterr_errno);
+		else
+			r = _writer_put(writer, ",done", 5, reterr_errno);
+	}
+	if (r == AGENDA_OK)
+		r = _writer_put(writer, "\t", 1, reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_put(writer, entry->title->array,
+		                entry->title->count, reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_put(writer, "\n", 1, reterr_errno);
+	return r;
+}
+
+int
+agenda_file_write(const char *path, struct agenda_file *file, int flags,
+                  int *reterr_errno)
+{
+	struct _writer writer = { NULL, NULL, 0 };
+	char *tmp_path = NULL;
+	size_t i = 0;
+	int r = 0;
+
+	writer.buffer = malloc(AGENDA_WRITE_BUFFER_SIZE);
+	if (writer.buffer == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+
+	/* Everything goes to a sibling file that is renamed over `path` once
+	 * complete, so readers see either the old or the new agenda. Its name
+	 * is unique, so concurrent writers don't write into each other's. */
+	r = _fs_error(fs_temp_open(path, &writer.fd, &tmp_path, reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	/* We do our own buffering, let each flush be a single write. */
+	setvbuf(writer.fd, NULL, _IONBF, 0);
+
+	r = _writer_header(&writer, &file->last_run, reterr_errno);
+	for (i = 0; r == AGENDA_OK && i < file->entry_count; i++)
+		r = _writer_entry(&writer, &file->entry_array[i], reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_flush(&writer, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	if ((flags & AGENDA_WRITE_SYNC) &&
+	    fs_sync(writer.fd, reterr_errno) != FS_OK)
+	{
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	if (fclose(writer.fd) != 0)
+	{
+		writer.fd = NULL;
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+	writer.fd = NULL;
+
+	r = _fs_error(fs_replace(tmp_path, path, flags & AGENDA_WRITE_SYNC,
+	                         reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = AGENDA_OK;
+_done:
+	if (writer.fd != NULL)
+		fclose(writer.fd);
+	if (r != AGENDA_OK && tmp_path != NULL)
+		remove(tmp_path);
+	if (writer.buffer != NULL)
+		free(writer.buffer);
+	if (tmp_path != NULL)
+		free(tmp_path);
+	return r;
+}
+
+/* Appends and compaction hold a lock on "<path>.lock" for their whole run, so
+ * records appended while a compaction reads the file aren't lost when it
+ * replaces it. `path` itself can't be locked, it's the file being replaced. */
+static int
+_lock_open(const char *path, FILE **ret_fd, int *reterr_errno)
+{
+	FILE *fd = NULL;
+	char *lock_path = NULL;
+	size_t path_count = 0;
+	int r = 0;
+
+	path_count = strlen(path);
+	lock_path = malloc(path_count + sizeof(".lock"));
+	if (lock_path == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	memcpy(lock_path, path, path_count);
+	memcpy(&lock_path[path_count], ".lock", sizeof(".lock"));
+
+	fd = fopen(lock_path, "ab");
+	if (fd == NULL)
+	{
+		switch (errno)
+		{
+			case EACCES:
+				r = AGENDA_EACCES;
+				goto _done;
+
+			case ENOENT:
+				r = AGENDA_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				r = AGENDA_EERRNO;
+				goto _done;
+		}
+	}
+
+	r = _fs_error(fs_lock(fd, reterr_errno));
+	if (r != AGENDA_OK)
+		goto _done;
+
+	*ret_fd = fd;
+	fd = NULL;
+	r = AGENDA_OK;
+_done:
+	if (fd != NULL)
+		fclose(fd);
+	if (lock_path != NULL)
+		free(lock_path);
+	return r;
+}
+
+/* A file not ending in a new line either was cut short by an append that
+ * never finished, or was last saved by an editor that doesn't end files with
+ * one. A last line that doesn't parse is a partial record and is dropped, one
+ * that does is kept and `ret_newline` is set to finish it. */
+static int
+_writer_fix_tail(FILE *fd, int *ret_newline, int *reterr_errno)
+{
+	struct agenda_entry parsed = AGENDA_ENTRY_ZERO;
+	struct date last_run = DATE_ZERO;
+	struct str tag_csv = { 0, NULL };
+	struct str title = { 0, NULL };
+	char chunk[512];
+	char *tail = NULL;
+	long start = 0;
+	long end = 0;
+	long file_end = 0;
+	size_t count = 0;
+	int kind = 0;
+	int r = 0;
+
+	*ret_newline = 0;
+
+	/* An empty file fails to seek, and has nothing to fix either. */
+	if (fseek(fd, -1, SEEK_END) != 0 || fgetc(fd) == '\n')
+		return AGENDA_OK;
+
+	if (fseek(fd, 0, SEEK_END) != 0 || (file_end = ftell(fd)) < 0)
+	{
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	/* Back to just after the last new line, or the start of the file. */
+	end = file_end;
+	while (end > 0)
+	{
+		start = (end > (long)sizeof(chunk)) ? end - (long)sizeof(chunk)
+		                                    : 0;
+		count = end - start;
+		if (fseek(fd, start, SEEK_SET) != 0 ||
+		    fread(chunk, 1, count, fd) != count)
+		{
+			r = AGENDA_EERRNO;
+			goto _done;
+		}
+		while (count > 0 && chunk[count - 1] != '\n')
+			count--;
+		end = start + count;
+		if (count > 0)
+			break;
+	}
+
+	count = file_end - end;
+	tail = malloc(count);
+	if (tail == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	if (fseek(fd, end, SEEK_SET) != 0 || fread(tail, 1, count, fd) != count)
+	{
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	if (_line_parse(tail, count, &last_run, &parsed, &tag_csv, &title,
+	                &kind) == AGENDA_OK)
+	{
+		*ret_newline = 1;
+		r = AGENDA_OK;
+		goto _done;
+	}
+
+	if (fs_truncate(fd, end, reterr_errno) != FS_OK)
+	{
+		free(tail);
+		return AGENDA_EERRNO;
+	}
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_EERRNO && reterr_errno != NULL)
+		*reterr_errno = errno;
+	if (tail != NULL)
+		free(tail);
+	return r;
+}
+
+/* Opens `path` for appending past the last complete record. */
+static int
+_writer_append_open(const char *path, struct _writer *writer,
+                    int *reterr_errno)
+{
+	int newline = 0;
+	int r = 0;
+
+	writer->count = 0;
+	writer->buffer = malloc(AGENDA_WRITE_BUFFER_SIZE);
+	if (writer->buffer == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+
+	writer->fd = fopen(path, "a+b");
+	if (writer->fd == NULL)
+	{
+		switch (errno)
+		{
+			case EACCES:
+				r = AGENDA_EACCES;
+				goto _done;
+
+			case ENOENT:
+				r = AGENDA_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				r = AGENDA_EERRNO;
+				goto _done;
+		}
+	}
+
+	setvbuf(writer->fd, NULL, _IONBF, 0);
+
+	r = _writer_fix_tail(writer->fd, &newline, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+	if (newline)
+		writer->buffer[writer->count++] = '\n';
+
+	if (fseek(writer->fd, 0, SEEK_END) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = AGENDA_EERRNO;
+		goto _done;
+	}
+
+	r = AGENDA_OK;
+_done:
+	if (r != AGENDA_OK)
+	{
+		if (writer->fd != NULL)
+			fclose(writer->fd);
+		if (writer->buffer != NULL)
+			free(writer->buffer);
+		writer->fd = NULL;
+		writer->buffer = NULL;
+	}
+	return r;
+}
+
+static int
+_writer_append_close(struct _writer *writer, int flags, int *reterr_errno)
+{
+	int r = 0;
+
+	r = _writer_flush(writer, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
 
-	buffer = malloc(file_size);
-	if (buffer == NULL)
+	if ((flags & AGENDA_WRITE_SYNC) &&
+	    fs_sync(writer->fd, reterr_errno) != FS_OK)
 	{
-		r = AGENDA_EOOM;
+		r = AGENDA_EERRNO;
 		goto _done;
 	}
 
-	if (fseek(fd, 0, SEEK_SET) != 0)
+	r = AGENDA_OK;
+_done:
+	if (fclose(writer->fd) != 0 && r == AGENDA_OK)
 	{
 		if (reterr_errno != NULL)
 			*reterr_errno = errno;
 		r = AGENDA_EERRNO;
-		goto _done;
 	}
+	free(writer->buffer);
+	writer->fd = NULL;
+	writer->buffer = NULL;
+	return r;
+}
 
-	if (fread(buffer, 1, file_size, fd) != file_size)
+int
+agenda_file_append(const char *path, struct date *last_run,
+                   struct agenda_entry *entry_array, size_t entry_count,
+                   int flags, int *reterr_errno)
+{
+	struct _writer writer = { NULL, NULL, 0 };
+	FILE *lock = NULL;
+	size_t i = 0;
+	int r = 0;
+
+	r = _lock_open(path, &lock, reterr_errno);
+	if (r != AGENDA_OK)
+		return r;
+
+	r = _writer_append_open(path, &writer, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	for (i = 0; r == AGENDA_OK && i < entry_count; i++)
+		r = _writer_entry(&writer, &entry_array[i], reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_header(&writer, last_run, reterr_errno);
+
+	if (r != AGENDA_OK)
 	{
-		if (reterr_errno != NULL)
-			*reterr_errno = errno;
-		r = AGENDA_EERRNO;
+		fclose(writer.fd);
+		free(writer.buffer);
 		goto _done;
 	}
 
-	r = AGENDA_OK;
+	r = _writer_append_close(&writer, flags, reterr_errno);
 _done:
+	fclose(lock);
+	return r;
+}
+
+int
+agenda_file_append_done(const char *path, daynum day, struct str *tag,
+                        int flags, int *reterr_errno)
+{
+	char line[15 + DATE_FORMAT_MAX + 1] = "# ysarys: done ";
+	struct _writer writer = { NULL, NULL, 0 };
+	FILE *lock = NULL;
+	int count = 15;
+	int r = 0;
+
+	r = _lock_open(path, &lock, reterr_errno);
+	if (r != AGENDA_OK)
+		return r;
+
+	r = _writer_append_open(path, &writer, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	count += daynum_format(&line[count], day);
+	line[count++] = '\t';
+	r = _writer_put(&writer, line, count, reterr_errno);
+	if (r == AGENDA_OK)
+		r = _writer_put(&writer, tag->array, tag->count, reterr_errno);
 	if (r == AGENDA_OK)
+		r = _writer_put(&writer, "\n", 1, reterr_errno);
+
+	if (r != AGENDA_OK)
 	{
-		*ret_buffer = buffer;
-		*ret_count = file_size;
+		fclose(writer.fd);
+		free(writer.buffer);
+		goto _done;
 	}
-	else if (buffer != NULL)
-		free(buffer);
-	if (fd != NULL)
-		fclose(fd);
+
+	r = _writer_append_close(&writer, flags, reterr_errno);
+_done:
+	fclose(lock);
 	return r;
 }
 
 int
-agenda_file_read_alloc(const char *path, struct agenda_file **ret_file,
-                       int *reterr_errno)
+agenda_file_compact(const char *path, int flags, int *reterr_errno)
 {
-	char *buffer = NULL;
 	struct agenda_file *file = NULL;
-	size_t i = 0;
-	size_t mark = 0;
-	size_t buffer_count = 0;
-	size_t entry_count = 0;
-	size_t entry_i = 0;
+	FILE *lock = NULL;
 	int r = 0;
 
-	r = _file_read_alloc(path, &buffer, &buffer_count, reterr_errno);
+	r = _lock_open(path, &lock, reterr_errno);
 	if (r != AGENDA_OK)
 		goto _done;
 
-	for (i = 0; i < buffer_count; i++)
+	r = agenda_file_read_alloc(path, &file, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = agenda_entry_sort(file->entry_array, file->entry_count);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = agenda_file_write(path, file, flags, reterr_errno);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	r = AGENDA_OK;
+_done:
+	if (file != NULL)
+		agenda_file_free(file);
+	if (lock != NULL)
+		fclose(lock);
+	return r;
+}
+
+struct _sort_key
+{
+	u32 key;
+	u32 index;
+};
+
+#define _SORT_RADIX_BITS 11
+#define _SORT_RADIX (1 << _SORT_RADIX_BITS)
+/* Parts smaller than this aren't worth a thread. */
+#define _SORT_PART_MIN (64 * 1024)
+
+/* A slice of the keys, counted and scattered by one thread. */
+struct _sort_part
+{
+	struct _sort_key *src;
+	struct _sort_key *dst;
+	size_t start;
+	size_t end;
+	unsigned shift;
+	size_t offset_array[_SORT_RADIX];
+};
+
+static void
+_sort_part_count(void *arg)
+{
+	struct _sort_part *part = arg;
+	size_t digit = 0;
+	size_t i = 0;
+
+	memset(part->offset_array, 0, sizeof part->offset_array);
+	for (i = part->start; i < part->end; i++)
 	{
-		if (buffer[i] != '#')
-			entry_count++;
-		for (; i < buffer_count; i++)
-			if (buffer[i] == '\n')
-				break;
+		digit = (part->src[i].key >> part->shift) & (_SORT_RADIX - 1);
+		part->offset_array[digit]++;
 	}
+}
 
-	file = malloc(sizeof *file);
-	if (file == NULL)
+static void
+_sort_part_scatter(void *arg)
+{
+	struct _sort_part *part = arg;
+	size_t digit = 0;
+	size_t i = 0;
+
+	for (i = part->start; i < part->end; i++)
 	{
-		r = AGENDA_EOOM;
+		digit = (part->src[i].key >> part->shift) & (_SORT_RADIX - 1);
+		part->dst[part->offset_array[digit]++] = part->src[i];
+	}
+}
+
+/* Stable LSD radix sort on the date key. Parts hold consecutive slices, so
+ * giving each one the digit offsets after those of the parts before it keeps
+ * equal keys in insertion order. */
+static int
+_entry_sort(struct agenda_entry *array, size_t count, size_t part_count)
+{
+	struct _sort_key *key_array = NULL;
+	struct _sort_key *tmp_array = NULL;
+	struct _sort_key *swap = NULL;
+	struct agenda_entry *entry_array = NULL;
+	struct _sort_part *part_array = NULL;
+	size_t offset = 0;
+	size_t digit_count = 0;
+	size_t i = 0;
+	size_t j = 0;
+	unsigned shift = 0;
+	u32 key_min = 0;
+	u32 key_max = 0;
+	int r = 0;
+
+	/* Already sorted, e.g. a compacted file with no journal. */
+	if (_entry_array_sorted(array, count))
+	{
+		r = AGENDA_OK;
 		goto _done;
 	}
-	file->last_run.day = 0;
-	file->last_run.month = 0;
-	file->last_run.year = 0;
 
-	file->entry_count = entry_count;
-	file->entry_array = malloc(sizeof *file->entry_array * entry_count);
-	if (file->entry_array == NULL)
+	/* Indexes are u32. */
+	if (count > 0xFFFFFFFFu)
+	{
+		qsort(array, count, sizeof *array, _entry_compare);
+		r = AGENDA_OK;
+		goto _done;
+	}
+
+	key_array = malloc(sizeof *key_array * count);
+	tmp_array = malloc(sizeof *tmp_array * count);
+	entry_array = malloc(sizeof *entry_array * count);
+	part_array = malloc(sizeof *part_array * part_count);
+	if (key_array == NULL || tmp_array == NULL || entry_array == NULL ||
+	    part_array == NULL)
 	{
 		r = AGENDA_EOOM;
 		goto _done;
 	}
-	for (i = 0; i < entry_count; i++)
+
+	key_min = key_max = _entry_key(&array[0]);
+	for (i = 0; i < count; i++)
 	{
-		file->entry_array[i].date.day = 0;
-		file->entry_array[i].date.month = 0;
-		file->entry_array[i].date.year = 0;
-		file->entry_array[i].title = NULL;
-		file->entry_array[i].tag_csv = NULL;
+		key_array[i].key = _entry_key(&array[i]);
+		key_array[i].index = i;
+		if (key_array[i].key < key_min)
+			key_min = key_array[i].key;
+		if (key_array[i].key > key_max)
+			key_max = key_array[i].key;
 	}
+	/* Only the digits that differ need a pass. */
+	for (i = 0; i < count; i++)
+		key_array[i].key -= key_min;
 
-	for (i = 0; i < buffer_count; i++)
+	for (i = 0; i < part_count; i++)
 	{
-		if (buffer[i] == '#')
-		{
-			/* 29 = 19 for prefix + 10 for date */
-			if (buffer_count - i >= 29 &&
-			    strncmp(&buffer[i], "# ysarys: last_run ", 19) == 0)
-			{
-				r = scan_date(&buffer[i + 19], 10,
-				              &file->last_run);
-				if (r != SCAN_OK)
-				{
-					r = AGENDA_EINVALHEAD;
-					goto _done;
-				}
-				for (i += 29; i < buffer_count; i++)
-					if (buffer[i] == '\n')
-						break;
-			}
-			else
-			{
-				r = AGENDA_EINVALHEAD;
-				goto _done;
-			}
-		}
-		/* 12 = 10 for date + 2 \t */
-		else if (buffer_count - i < 12)
+		part_array[i].start = count / part_count * i;
+		part_array[i].end =
+		    i + 1 == part_count ? count : count / part_count * (i + 1);
+	}
+
+	for (shift = 0; shift < 32 && ((key_max - key_min) >> shift) != 0;
+	     shift += _SORT_RADIX_BITS)
+	{
+		for (i = 0; i < part_count; i++)
 		{
-			r = AGENDA_EINVALENTRY;
-			goto _done;
+			part_array[i].src = key_array;
+			part_array[i].dst = tmp_array;
+			part_array[i].shift = shift;
 		}
-		else
+		_parallel_run(_sort_part_count, part_array, sizeof *part_array,
+		              part_count);
+
+		offset = 0;
+		for (j = 0; j < _SORT_RADIX; j++)
 		{
-			r = scan_date(&buffer[i], 10,
-			              &file->entry_array[entry_i].date);
-			if (r != SCAN_OK)
-			{
-				r = AGENDA_EINVALENTRY;
-				goto _done;
-			}
-			if (buffer[i + 10] != '\t')
-			{
-				r = AGENDA_EINVALENTRY;
-				goto _done;
-			}
-			i += 11;
-			mark = i;
-			for (; i < buffer_count; i++)
-				if (buffer[i] == '\t' || buffer[i] == '\n')
-					break;
-			r = str_slice_alloc(
-			    &buffer[mark], i - mark,
-			    &file->entry_array[entry_i].tag_csv);
-			if (r != STR_OK)
-			{
-				r = AGENDA_EOOM;
-				goto _done;
-			}
-			if (buffer[i] == '\t')
-				i++;
-			mark = i;
-			for (; i < buffer_count; i++)
-				if (buffer[i] == '\n')
-					break;
-			r = str_slice_alloc(&buffer[mark], i - mark,
-			                    &file->entry_array[entry_i].title);
-			if (r != STR_OK)
+			for (i = 0; i < part_count; i++)
 			{
-				r = AGENDA_EOOM;
-				goto _done;
+				digit_count = part_array[i].offset_array[j];
+				part_array[i].offset_array[j] = offset;
+				offset += digit_count;
 			}
-			entry_i++;
 		}
-		for (; i < buffer_count; i++)
-			if (buffer[i] == '\n')
-				break;
+		_parallel_run(_sort_part_scatter, part_array,
+		              sizeof *part_array, part_count);
+
+		swap = key_array;
+		key_array = tmp_array;
+		tmp_array = swap;
 	}
 
+	for (i = 0; i < count; i++)
+		entry_array[i] = array[key_array[i].index];
+	memcpy(array, entry_array, sizeof *array * count);
+
 	r = AGENDA_OK;
 _done:
-	if (r == AGENDA_OK)
-		*ret_file = file;
-	else if (file != NULL)
-	{
-		if (file->entry_array != NULL)
-		{
-			for (i = 0; i < entry_count; i++)
-			{
-				if (file->entry_array[i].title != NULL)
-					str_free(file->entry_array[i].title);
-				if (file->entry_array[i].tag_csv != NULL)
-					str_free(file->entry_array[i].tag_csv);
-			}
-			free(file->entry_array);
-		}
-		free(file);
-	}
-	if (buffer != NULL)
-		free(buffer);
+	if (key_array != NULL)
+		free(key_array);
+	if (tmp_array != NULL)
+		free(tmp_array);
+	if (entry_array != NULL)
+		free(entry_array);
+	if (part_array != NULL)
+		free(part_array);
 	return r;
 }
 
 int
-agenda_file_write(const char *path, struct agenda_file *file, int *reterr_errno)
+agenda_entry_sort(struct agenda_entry *array, size_t count)
 {
-	FILE *fd = NULL;
+	return _entry_sort(array, count, 1);
+}
+
+int
+agenda_entry_merge(struct agenda_entry *array, size_t mid, size_t count)
+{
+	struct agenda_entry *left = NULL;
+	size_t left_count = 0;
+	size_t start = 0;
 	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
 	int r = 0;
 
-	fd = fopen(path, "wb");
-	if (fd == NULL)
+	/* Nothing to do when the second run starts after the first, e.g. new
+	 * entries past the end of the agenda. */
+	if (mid == 0 || mid >= count ||
+	    _entry_key(&array[mid - 1]) <= _entry_key(&array[mid]))
 	{
-		switch (errno)
-		{
-			case EACCES:
-				r = AGENDA_EACCES;
-				goto _done;
+		r = AGENDA_OK;
+		goto _done;
+	}
 
-			case ENOENT:
-				r = AGENDA_ENOENT;
-				goto _done;
+	/* Entries of the first run up to the start of the second one stay. */
+	for (start = 0; start < mid; start++)
+		if (_entry_key(&array[start]) > _entry_key(&array[mid]))
+			break;
 
-			default:
-				if (reterr_errno != NULL)
-					*reterr_errno = errno;
-				r = AGENDA_EERRNO;
-				goto _done;
-		}
+	left_count = mid - start;
+	left = malloc(sizeof *left * left_count);
+	if (left == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
 	}
+	memcpy(left, &array[start], sizeof *left * left_count);
 
-	fprintf(fd, "# ysarys: last_run ");
-	date_fprintf(fd, &file->last_run);
-	fprintf(fd, "\n");
-
-	for (i = 0; i < file->entry_count; i++)
+	/* Ties go to the first run, which keeps the merge stable. */
+	i = 0;
+	j = mid;
+	k = start;
+	while (i < left_count && j < count)
 	{
-		date_fprintf(fd, &file->entry_array[i].date);
-		fprintf(fd, "\t");
-		str_print(fd, file->entry_array[i].tag_csv);
-		fprintf(fd, "\t");
-		str_print(fd, file->entry_array[i].title);
-		fprintf(fd, "\n");
+		if (_entry_key(&array[j]) < _entry_key(&left[i]))
+			array[k++] = array[j++];
+		else
+			array[k++] = left[i++];
 	}
+	while (i < left_count)
+		array[k++] = left[i++];
+
 	r = AGENDA_OK;
 _done:
-	if (fd != NULL)
-		fclose(fd);
+	if (left != NULL)
+		free(left);
 	return r;
 }
 
 int
-agenda_entry_sort(struct agenda_entry *array, size_t count)
+agenda_entry_sort_parallel(struct agenda_entry *array, size_t count,
+                           int thread_count)
 {
-	qsort(array, count, sizeof *array, _entry_compare);
-	return AGENDA_OK;
+	size_t part_count = 0;
+
+	if (thread_count <= 0)
+		thread_count = thread_cpu_count();
+	part_count = count / _SORT_PART_MIN + 1;
+	if (part_count > (size_t)thread_count)
+		part_count = thread_count;
+	if (part_count > _PARALLEL_THREAD_MAX)
+		part_count = _PARALLEL_THREAD_MAX;
+	return _entry_sort(array, count, part_count);
 }
 
 void
@@ -321,7 +1928,8 @@ agenda_file_free(struct agenda_file *file)
 {
 	size_t i = 0;
 
-	if (file->entry_array != NULL)
+	if (file->entry_array != NULL && file->slice_array == NULL &&
+	    file->intern == NULL)
 	{
 		for (i = 0; i < file->entry_count; i++)
 		{
@@ -333,9 +1941,18 @@ agenda_file_free(struct agenda_file *file)
 				str_free(file->entry_array[i].tag_csv);
 			file->entry_array[i].tag_csv = NULL;
 		}
+	}
+	if (file->entry_array != NULL)
+	{
 		free(file->entry_array);
 		file->entry_array = NULL;
 	}
+	if (file->slice_array != NULL)
+	{
+		free(file->slice_array);
+		file->slice_array = NULL;
+	}
+	fs_unmap(&file->map);
 	file->entry_count = 0;
 	free(file);
 }
@@ -355,6 +1972,8 @@ agenda_array_alloc(size_t capacity, struct agenda_array **ret_array)
 
 	array->count = 0;
 	array->capacity = capacity;
+	array->intern = NULL;
+	array->dedup = NULL;
 	array->array = malloc(sizeof *array->array * capacity);
 	if (array->array == NULL)
 	{
@@ -378,8 +1997,8 @@ _done:
 }
 
 int
-agenda_array_push_alloc(struct agenda_array *array, struct date *date,
-                        struct str **mov_title, struct str **mov_tag_csv)
+agenda_array_push_entry_alloc(struct agenda_array *array,
+                              struct agenda_entry *mov_entry)
 {
 	int r = 0;
 	struct agenda_entry *new_array = NULL;
@@ -400,15 +2019,17 @@ agenda_array_push_alloc(struct agenda_array *array, struct date *date,
 		array->array = new_array;
 	}
 
-	array->array[array->count].date.day = date->day;
-	array->array[array->count].date.month = date->month;
-	array->array[array->count].date.year = date->year;
-
-	array->array[array->count].title = *mov_title;
-	*mov_title = NULL;
+	if (array->dedup != NULL &&
+	    agenda_dedup_put(array->dedup, mov_entry->day,
+	                     mov_entry->tag_csv) != AGENDA_DEDUP_OK)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
 
-	array->array[array->count].tag_csv = *mov_tag_csv;
-	*mov_tag_csv = NULL;
+	array->array[array->count] = *mov_entry;
+	mov_entry->title = NULL;
+	mov_entry->tag_csv = NULL;
 
 	array->count += 1;
 
@@ -417,12 +2038,35 @@ _done:
 	return r;
 }
 
+int
+agenda_array_push_alloc(struct agenda_array *array, daynum day,
+                        struct str **mov_title, struct str **mov_tag_csv)
+{
+	struct agenda_entry entry = AGENDA_ENTRY_ZERO;
+	int r = 0;
+
+	entry.day = day;
+	entry.title = *mov_title;
+	entry.tag_csv = *mov_tag_csv;
+
+	r = agenda_array_push_entry_alloc(array, &entry);
+	if (r != AGENDA_OK)
+		goto _done;
+
+	*mov_title = NULL;
+	*mov_tag_csv = NULL;
+
+	r = AGENDA_OK;
+_done:
+	return r;
+}
+
 void
 agenda_array_free(struct agenda_array *array)
 {
 	size_t i = 0;
 
-	for (i = 0; i < array->count; i++)
+	for (i = 0; i < array->count && array->intern == NULL; i++)
 	{
 		str_free(array->array[i].title);
 		str_free(array->array[i].tag_csv);
@@ -454,34 +2098,65 @@ agenda_file_array_set_alloc(struct agenda_file *file,
 
 	for (i = 0; i < array->count; i++)
 	{
-		r = str_dup_alloc(array->array[i].title, &new_title);
-		if (r != STR_OK)
+		if (file->intern != NULL)
 		{
-			r = AGENDA_EOOM;
-			goto _done;
+			/* Interned strings are shared, nothing to own. */
+			r = intern_put_str(file->intern,
+			                   array->array[i].title->array,
+			                   array->array[i].title->count,
+			                   &new_array[i].title);
+			if (r == INTERN_OK)
+				r = intern_put_str(
+				    file->intern,
+				    array->array[i].tag_csv->array,
+				    array->array[i].tag_csv->count,
+				    &new_array[i].tag_csv);
+			if (r != INTERN_OK)
+			{
+				r = AGENDA_EOOM;
+				goto _done;
+			}
 		}
-		new_array[i].title = new_title;
-		new_title = NULL;
-
-		r = str_dup_alloc(array->array[i].tag_csv, &new_tag_csv);
-		if (r != STR_OK)
+		else
 		{
-			r = AGENDA_EOOM;
-			goto _done;
+			r = str_dup_alloc(array->array[i].title, &new_title);
+			if (r != STR_OK)
+			{
+				r = AGENDA_EOOM;
+				goto _done;
+			}
+			new_array[i].title = new_title;
+			new_title = NULL;
+
+			r = str_dup_alloc(array->array[i].tag_csv,
+			                  &new_tag_csv);
+			if (r != STR_OK)
+			{
+				r = AGENDA_EOOM;
+				goto _done;
+			}
+			new_array[i].tag_csv = new_tag_csv;
+			new_tag_csv = NULL;
 		}
-		new_array[i].tag_csv = new_tag_csv;
-		new_tag_csv = NULL;
 
-		new_array[i].date.day = array->array[i].date.day;
-		new_array[i].date.month = array->array[i].date.month;
-		new_array[i].date.year = array->array[i].date.year;
+		new_array[i].day = array->array[i].day;
+		new_array[i].done = array->array[i].done;
 	}
 
 	if (file->entry_array != NULL)
 		free(file->entry_array);
 
+	/* New entries own their strings, slices into the mapping are gone. */
+	if (file->slice_array != NULL)
+	{
+		free(file->slice_array);
+		file->slice_array = NULL;
+		fs_unmap(&file->map);
+	}
+
 	file->entry_count = array->count;
 	file->entry_array = new_array;
+	file->sorted = _entry_array_sorted(new_array, array->count);
 	new_array = NULL;
 
 	r = AGENDA_OK;
@@ -18,35 +18,74 @@
 #ifndef AGENDA_H
 #define AGENDA_H
 
+#include "agenda_dedup.h"
 #include "date.h"
+#include "fs.h"
+#include "intern.h"
 #include "str.h"
 
 struct agenda_entry
 {
-	struct date date;
+	daynum day;
 	struct str *title;
 	struct str *tag_csv;
+	/* Marked done by the journal, "done" may not be in tag_csv yet. */
+	int done;
 };
 
-#define AGENDA_ENTRY_ZERO { DATE_ZERO, NULL, NULL }
+#define AGENDA_ENTRY_ZERO { 0, NULL, NULL, 0 }
 
 struct agenda_file
 {
 	struct date last_run;
+	/* Records appended since the file was last compacted. */
+	size_t journal_count;
 	size_t entry_count;
 	struct agenda_entry *entry_array;
+	/* Set when the file was mapped, entries point into it. */
+	struct str *slice_array;
+	struct fs_map map;
+	/* Set when strings are interned, they are owned by it. */
+	struct intern *intern;
+	/* non-0 = entries are in date order, checked while reading. */
+	int sorted;
 };
 
+/* Reads an agenda one entry at a time with a fixed size buffer. */
+struct agenda_iter
+{
+	FILE *fd;
+	int owns_fd;
+	int eof;
+	char *buffer;
+	size_t count;
+	size_t offset;
+	struct date last_run;
+	struct str title;
+	struct str tag_csv;
+	/* First tag and day of every done record, once loaded. */
+	struct intern *done_intern;
+	struct agenda_dedup *done;
+};
+
+#define AGENDA_ITER_BUFFER_SIZE (64 * 1024)
+
 struct agenda_array
 {
 	size_t count;
 	size_t capacity;
 	struct agenda_entry *array;
+	/* Set when strings are interned, they are owned by it. Entries pushed
+	 * in must come from the same table. */
+	struct intern *intern;
+	/* Set to track which rule fired on which day, see `rule_run`. */
+	struct agenda_dedup *dedup;
 };
 
 enum
 {
 	AGENDA_OK = 0,
+	AGENDA_OK_DONE,    /* Iterator has no more entries */
 	AGENDA_EOOM,       /* Out of memory */
 	AGENDA_EACCES,     /* Permission denied */
 	AGENDA_ENOENT,     /* No such file */
@@ -59,11 +98,100 @@ enum
 int agenda_file_read_alloc(const char *path, struct agenda_file **ret_file,
                            int *reterr_errno);
 
-int agenda_file_write(const char *path, struct agenda_file *file,
+/* Same as `agenda_file_read_alloc`, but titles and tags are interned in
+ * `intern`, repeated strings share one copy. `intern` must outlive the file. */
+int agenda_file_read_intern_alloc(const char *path, struct intern *intern,
+                                  struct agenda_file **ret_file,
+                                  int *reterr_errno);
+
+/* Same as `agenda_file_read_alloc`, but maps the file in memory. Titles and
+ * tags are slices into the mapping: they are not NUL terminated and must not be
+ * moved out of the file, they are only valid until `agenda_file_free`. The
+ * mapping is read-only, writing through a title or tag crashes; copy it into a
+ * new `struct str` to change it. */
+int agenda_file_map_alloc(const char *path, struct agenda_file **ret_file,
+                          int *reterr_errno);
+
+/* Same as `agenda_file_map_alloc`, but the mapping is split at line boundaries
+ * and parsed by up to `thread_count` threads, 0 = one per CPU. Small files
+ * still parse on the calling thread. */
+int agenda_file_map_parallel_alloc(const char *path, int thread_count,
+                                   struct agenda_file **ret_file,
+                                   int *reterr_errno);
+
+/* Mapped read of the entries from `from` to `to`, both inclusive. Uses the
+ * "<path>.idx" sidecar, building or refreshing it as needed, to parse only the
+ * lines in range plus the journal. */
+int agenda_file_range_alloc(const char *path, daynum from, daynum to,
+                            struct agenda_file **ret_file, int *reterr_errno);
+
+int agenda_iter_open_alloc(const char *path, struct agenda_iter **ret_iter,
+                           int *reterr_errno);
+
+/* Iterates over an already opened file, e.g. stdin. `fd` is not closed. */
+int agenda_iter_fd_alloc(FILE *fd, struct agenda_iter **ret_iter);
+
+/* OK | OK_DONE | error. Headers are consumed and update `last_run`, done
+ * records are skipped. Title and tag_csv of `ret_entry` point into the
+ * iterator and are only valid until the next call. */
+int agenda_iter_next(struct agenda_iter *iter, struct agenda_entry *ret_entry,
+                     int *reterr_errno);
+
+/* OK | error. Done records come after the entries they refer to, so this reads
+ * ahead to the end of the file for them and seeks back. Entries returned from
+ * then on are marked done when any done record refers to them. Fails with
+ * EERRNO before reading anything when the file can't seek, e.g. a pipe. */
+int agenda_iter_done_load(struct agenda_iter *iter, int *reterr_errno);
+
+void agenda_iter_close(struct agenda_iter *iter);
+
+/* non-0 = `tag` is one of the comma separated values of `tag_csv` */
+int agenda_entry_has_tag(struct agenda_entry *entry, const char *tag,
+                         size_t tag_count);
+
+/* Flags for `agenda_file_write`. */
+enum
+{
+	AGENDA_WRITE_SYNC = 1 /* fsync before returning */
+};
+
+#define AGENDA_WRITE_BUFFER_SIZE (256 * 1024)
+
+/* Writes to a temp file next to `path` and renames it over `path`, so `path`
+ * is never seen half written. Keeps the permissions `path` had. */
+int agenda_file_write(const char *path, struct agenda_file *file, int flags,
                       int *reterr_errno);
 
+/* The agenda file doubles as a journal: appended entries, last_run headers and
+ * "# ysarys: done YYYY-MM-DD\t<tag>" records are replayed on read, so a run
+ * only writes what changed. A done record marks every entry of that date whose
+ * first tag is <tag>. A last line with no new line is completed before
+ * appending when it parses, and dropped as an append cut short when not. */
+int agenda_file_append(const char *path, struct date *last_run,
+                       struct agenda_entry *entry_array, size_t entry_count,
+                       int flags, int *reterr_errno);
+
+int agenda_file_append_done(const char *path, daynum day, struct str *tag,
+                            int flags, int *reterr_errno);
+
+/* Folds the journal back into a sorted file. Appends wait for it on
+ * "<path>.lock", a file left next to `path`. */
+int agenda_file_compact(const char *path, int flags, int *reterr_errno);
+
+#define AGENDA_JOURNAL_COMPACT_THRESHOLD 64
+
+/* Sorts by date in O(n), entries of the same date keep their order. */
 int agenda_entry_sort(struct agenda_entry *array, size_t count);
 
+/* Merges the sorted runs [0, mid) and [mid, count) of `array` in O(count).
+ * Entries of the same date keep their order, the first run's first. */
+int agenda_entry_merge(struct agenda_entry *array, size_t mid, size_t count);
+
+/* Same as `agenda_entry_sort`, on up to `thread_count` threads, 0 = one per
+ * CPU. Small arrays still sort on the calling thread. */
+int agenda_entry_sort_parallel(struct agenda_entry *array, size_t count,
+                               int thread_count);
+
 void agenda_file_free(struct agenda_file *file);
 
 int agenda_file_array_set_alloc(struct agenda_file *file,
@@ -71,7 +199,11 @@ int agenda_file_array_set_alloc(struct agenda_file *file,
 
 int agenda_array_alloc(size_t capacity, struct agenda_array **ret_array);
 
-int agenda_array_push_alloc(struct agenda_array *array, struct date *date,
+/* Also adds the entry to `array->dedup`, when set. */
+int agenda_array_push_entry_alloc(struct agenda_array *array,
+                                  struct agenda_entry *mov_entry);
+
+int agenda_array_push_alloc(struct agenda_array *array, daynum day,
                             struct str **mov_title, struct str **mov_tag_csv);
 
 void agenda_array_free(struct agenda_array *array);
@@ -0,0 +1,175 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "agenda_dedup.h"
+#include "memscan.h"
+#include <stdlib.h>
+
+#define _SLOT_CAPACITY_MIN 64
+
+static u32
+_hash(u32 tag_id, daynum day)
+{
+	u32 hash = 0;
+
+	hash = tag_id * 0x9E3779B1u ^ (u32)day * 0x85EBCA77u;
+	return hash ^ (hash >> 15);
+}
+
+static int
+_tag_id(struct agenda_dedup *dedup, struct str *tag_csv, u32 *ret_tag_id)
+{
+	size_t count = 0;
+
+	count = memscan_byte(tag_csv->array, tag_csv->count, ',');
+	if (intern_put(dedup->intern, tag_csv->array, count, ret_tag_id) !=
+	    INTERN_OK)
+		return AGENDA_DEDUP_EOOM;
+	return AGENDA_DEDUP_OK;
+}
+
+/* Index of the slot of (`tag_id`, `day`), or of the empty one where it
+ * belongs. */
+static size_t
+_find(struct agenda_dedup_slot *slot_array, size_t slot_capacity, u32 tag_id,
+      daynum day)
+{
+	size_t mask = slot_capacity - 1;
+	size_t i = 0;
+
+	for (i = _hash(tag_id, day) & mask; slot_array[i].tag_id_1 != 0;
+	     i = (i + 1) & mask)
+		if (slot_array[i].tag_id_1 == tag_id + 1 &&
+		    slot_array[i].day == day)
+			break;
+	return i;
+}
+
+static int
+_grow(struct agenda_dedup *dedup)
+{
+	struct agenda_dedup_slot *slot_array = NULL;
+	struct agenda_dedup_slot *slot = NULL;
+	size_t capacity = 0;
+	size_t i = 0;
+
+	capacity = dedup->slot_capacity * 2;
+	slot_array = calloc(capacity, sizeof *slot_array);
+	if (slot_array == NULL)
+		return AGENDA_DEDUP_EOOM;
+
+	for (i = 0; i < dedup->slot_capacity; i++)
+	{
+		slot = &dedup->slot_array[i];
+		if (slot->tag_id_1 != 0)
+			slot_array[_find(slot_array, capacity, slot->tag_id_1 - 1,
+			                 slot->day)] = *slot;
+	}
+
+	free(dedup->slot_array);
+	dedup->slot_array = slot_array;
+	dedup->slot_capacity = capacity;
+	return AGENDA_DEDUP_OK;
+}
+
+int
+agenda_dedup_alloc(struct intern *intern, struct agenda_dedup **ret_dedup)
+{
+	struct agenda_dedup *dedup = NULL;
+	int r = 0;
+
+	dedup = malloc(sizeof *dedup);
+	if (dedup == NULL)
+	{
+		r = AGENDA_DEDUP_EOOM;
+		goto _done;
+	}
+	dedup->count = 0;
+	dedup->slot_capacity = _SLOT_CAPACITY_MIN;
+	dedup->intern = intern;
+
+	dedup->slot_array =
+	    calloc(dedup->slot_capacity, sizeof *dedup->slot_array);
+	if (dedup->slot_array == NULL)
+	{
+		r = AGENDA_DEDUP_EOOM;
+		goto _done;
+	}
+
+	r = AGENDA_DEDUP_OK;
+	*ret_dedup = dedup;
+_done:
+	if (r != AGENDA_DEDUP_OK && dedup != NULL)
+		free(dedup);
+	return r;
+}
+
+int
+agenda_dedup_has(struct agenda_dedup *dedup, daynum day, struct str *tag_csv,
+                 int *ret_has)
+{
+	size_t count = 0;
+	size_t i = 0;
+	u32 tag_id = 0;
+
+	/* A tag never interned was never put, no need to add it. */
+	count = memscan_byte(tag_csv->array, tag_csv->count, ',');
+	if (intern_get(dedup->intern, tag_csv->array, count, &tag_id) !=
+	    INTERN_OK)
+	{
+		*ret_has = 0;
+		return AGENDA_DEDUP_OK;
+	}
+
+	i = _find(dedup->slot_array, dedup->slot_capacity, tag_id, day);
+	*ret_has = dedup->slot_array[i].tag_id_1 != 0;
+	return AGENDA_DEDUP_OK;
+}
+
+int
+agenda_dedup_put(struct agenda_dedup *dedup, daynum day, struct str *tag_csv)
+{
+	size_t i = 0;
+	u32 tag_id = 0;
+
+	if (_tag_id(dedup, tag_csv, &tag_id) != AGENDA_DEDUP_OK)
+		return AGENDA_DEDUP_EOOM;
+
+	i = _find(dedup->slot_array, dedup->slot_capacity, tag_id, day);
+	if (dedup->slot_array[i].tag_id_1 != 0)
+		return AGENDA_DEDUP_OK;
+
+	if (dedup->count + 1 > dedup->slot_capacity / 2)
+	{
+		if (_grow(dedup) != AGENDA_DEDUP_OK)
+			return AGENDA_DEDUP_EOOM;
+		i = _find(dedup->slot_array, dedup->slot_capacity, tag_id,
+		          day);
+	}
+
+	dedup->slot_array[i].tag_id_1 = tag_id + 1;
+	dedup->slot_array[i].day = day;
+	dedup->count++;
+	return AGENDA_DEDUP_OK;
+}
+
+void
+agenda_dedup_free(struct agenda_dedup *dedup)
+{
+	free(dedup->slot_array);
+	free(dedup);
+}
@@ -0,0 +1,63 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef AGENDA_DEDUP_H
+#define AGENDA_DEDUP_H
+
+#include "date.h"
+#include "intdef.h"
+#include "intern.h"
+#include "str.h"
+
+/* `tag_id` + 1, 0 = empty slot. */
+struct agenda_dedup_slot
+{
+	u32 tag_id_1;
+	daynum day;
+};
+
+/* Set of (first tag, date) pairs. The first tag of an entry is the name of
+ * the rule that generated it, see `rule_run`, so a rule fires at most once
+ * per day. */
+struct agenda_dedup
+{
+	size_t count;
+	size_t slot_capacity;
+	struct agenda_dedup_slot *slot_array;
+	/* First tags are interned here to get their ids. */
+	struct intern *intern;
+};
+
+enum
+{
+	AGENDA_DEDUP_OK,
+	AGENDA_DEDUP_EOOM
+};
+
+int agenda_dedup_alloc(struct intern *intern, struct agenda_dedup **ret_dedup);
+
+/* `ret_has` is set to non-0 when the first tag of `tag_csv` is already in the
+ * set for `day`. Looking up adds nothing to the intern table. */
+int agenda_dedup_has(struct agenda_dedup *dedup, daynum day,
+                     struct str *tag_csv, int *ret_has);
+
+int agenda_dedup_put(struct agenda_dedup *dedup, daynum day,
+                     struct str *tag_csv);
+
+void agenda_dedup_free(struct agenda_dedup *dedup);
+
+#endif /* !AGENDA_DEDUP_H */
@@ -0,0 +1,399 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "agenda_index.h"
+#include "agenda.h"
+#include "date.h"
+#include "fs.h"
+#include "memscan.h"
+#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* On disk layout, followed by `day_count` `struct agenda_index_day`. Native
+ * endianness, the index is a cache of the machine it was built on. */
+struct _header
+{
+	char magic[8];
+	u32 version;
+	u32 reserved;
+	u64 file_size;
+	i64 file_mtime;
+	u64 sorted_end;
+	u64 sorted_hash;
+	u64 day_count;
+};
+
+static const char _magic[8] = { 'y', 's', 'a', 'r', 'y', 's', 'i', 'x' };
+
+/* FNV-1a, 64 bits. Constants are built from halves, `long` may be 32 bits. */
+#define _HASH_OFFSET (((u64)0xcbf29ce4 << 32) | 0x84222325)
+#define _HASH_PRIME (((u64)0x100 << 32) | 0x1b3)
+
+static u64
+_hash(u64 hash, const char *array, size_t count)
+{
+	size_t i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		hash ^= (unsigned char)array[i];
+		hash *= _HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static int
+_day_push(struct agenda_index *index, daynum day, u64 offset)
+{
+	struct agenda_index_day *new_array = NULL;
+	u64 new_capacity = 0;
+
+	if (index->day_count >= index->day_capacity)
+	{
+		new_capacity = index->day_capacity * 2 + 64;
+		new_array = realloc(index->day_array,
+		                    sizeof *new_array * new_capacity);
+		if (new_array == NULL)
+			return AGENDA_EOOM;
+
+		index->day_capacity = new_capacity;
+		index->day_array = new_array;
+	}
+
+	index->day_array[index->day_count].day = day;
+	index->day_array[index->day_count].reserved = 0;
+	index->day_array[index->day_count].offset = offset;
+	index->day_count++;
+	return AGENDA_OK;
+}
+
+/* Indexes lines from `sorted_end` on, for as long as entries stay sorted. */
+static int
+_scan(struct agenda_index *index, const char *buffer, size_t buffer_count)
+{
+	struct date date = DATE_ZERO;
+	size_t mark = 0;
+	size_t i = 0;
+	daynum day = 0;
+	int r = 0;
+
+	for (mark = index->sorted_end; mark < buffer_count; mark = i + 1)
+	{
+		i = mark +
+		    memscan_byte(&buffer[mark], buffer_count - mark, '\n');
+
+		if (buffer[mark] == '#')
+		{
+			/* Records past the first entry, like done records and
+			 * the last_run of each append, aren't tied to a day,
+			 * whoever reads a range must see them all. Those
+			 * before it are read along with the first entry. */
+			if (index->day_count > 0 && i - mark >= 9 &&
+			    strncmp(&buffer[mark], "# ysarys:", 9) == 0)
+				break;
+		}
+		else
+		{
+			if (i - mark < 10 ||
+			    scan_date(&buffer[mark], 10, &date) != SCAN_OK)
+				break;
+
+			day = daynum_from_date(&date);
+			if (index->day_count > 0 &&
+			    day < index->day_array[index->day_count - 1].day)
+				break;
+
+			if (index->day_count == 0 ||
+			    day > index->day_array[index->day_count - 1].day)
+			{
+				r = _day_push(index, day, mark);
+				if (r != AGENDA_OK)
+					return r;
+			}
+		}
+
+		index->sorted_end = i < buffer_count ? i + 1 : i;
+	}
+
+	return AGENDA_OK;
+}
+
+/* Bytes hashed from the end of the sorted part. */
+#define _HASH_TAIL 64
+
+/* FNV-1a of the bytes the index points at: the new line and date starting
+ * each day, and the end of the sorted part. An edit to the sorted part that
+ * adds or removes bytes moves them. */
+static u64
+_covered_hash(struct agenda_index *index, const char *buffer)
+{
+	u64 hash = _HASH_OFFSET;
+	u64 start = 0;
+	u64 end = 0;
+	u64 i = 0;
+
+	for (i = 0; i < index->day_count; i++)
+	{
+		start = index->day_array[i].offset;
+		end = start + 10;
+		if (start > 0)
+			start--;
+		if (end > index->sorted_end)
+			end = index->sorted_end;
+		hash = _hash(hash, &buffer[start], end - start);
+	}
+
+	start = index->sorted_end > _HASH_TAIL ? index->sorted_end - _HASH_TAIL
+	                                       : 0;
+	return _hash(hash, &buffer[start], index->sorted_end - start);
+}
+
+/* OK | EOOM | ENOENT, the latter for a missing or unusable index. Nothing in
+ * the sidecar is trusted: its size must match the day count, and offsets and
+ * days must be ascending and within the sorted part. */
+static int
+_read(const char *idx_path, struct agenda_index *index)
+{
+	struct _header header;
+	FILE *fd = NULL;
+	long idx_size = 0;
+	u64 i = 0;
+	int r = 0;
+
+	fd = fopen(idx_path, "rb");
+	if (fd == NULL)
+	{
+		r = AGENDA_ENOENT;
+		goto _done;
+	}
+
+	if (fseek(fd, 0, SEEK_END) != 0 || (idx_size = ftell(fd)) < 0 ||
+	    fseek(fd, 0, SEEK_SET) != 0 ||
+	    (u64)idx_size < sizeof header)
+	{
+		r = AGENDA_ENOENT;
+		goto _done;
+	}
+
+	if (fread(&header, sizeof header, 1, fd) != 1 ||
+	    memcmp(header.magic, _magic, sizeof _magic) != 0 ||
+	    header.version != AGENDA_INDEX_VERSION ||
+	    header.sorted_end > header.file_size ||
+	    header.day_count != ((u64)idx_size - sizeof header) /
+	                            sizeof *index->day_array ||
+	    ((u64)idx_size - sizeof header) % sizeof *index->day_array != 0)
+	{
+		r = AGENDA_ENOENT;
+		goto _done;
+	}
+
+	index->day_array = malloc(sizeof *index->day_array * header.day_count);
+	if (index->day_array == NULL && header.day_count > 0)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	index->day_capacity = header.day_count;
+
+	if (fread(index->day_array, sizeof *index->day_array, header.day_count,
+	          fd) != header.day_count)
+	{
+		r = AGENDA_ENOENT;
+		goto _done;
+	}
+
+	for (i = 0; i < header.day_count; i++)
+	{
+		if (index->day_array[i].offset >= header.sorted_end ||
+		    (i > 0 && (index->day_array[i].offset <=
+		                   index->day_array[i - 1].offset ||
+		               index->day_array[i].day <=
+		                   index->day_array[i - 1].day)))
+		{
+			r = AGENDA_ENOENT;
+			goto _done;
+		}
+	}
+
+	index->file_size = header.file_size;
+	index->file_mtime = header.file_mtime;
+	index->sorted_end = header.sorted_end;
+	index->sorted_hash = header.sorted_hash;
+	index->day_count = header.day_count;
+	r = AGENDA_OK;
+_done:
+	if (fd != NULL)
+		fclose(fd);
+	return r;
+}
+
+static void
+_write(const char *idx_path, struct agenda_index *index)
+{
+	struct _header header;
+	char *tmp_path = NULL;
+	FILE *fd = NULL;
+	int ok = 0;
+
+	memcpy(header.magic, _magic, sizeof _magic);
+	header.version = AGENDA_INDEX_VERSION;
+	header.reserved = 0;
+	header.file_size = index->file_size;
+	header.file_mtime = index->file_mtime;
+	header.sorted_end = index->sorted_end;
+	header.sorted_hash = index->sorted_hash;
+	header.day_count = index->day_count;
+
+	/* A name of its own, loads racing to save the index can't write into
+	 * each other's. */
+	if (fs_temp_open(idx_path, &fd, &tmp_path, NULL) != FS_OK)
+		return;
+
+	ok = fwrite(&header, sizeof header, 1, fd) == 1 &&
+	     fwrite(index->day_array, sizeof *index->day_array,
+	            index->day_count, fd) == index->day_count;
+	ok = fclose(fd) == 0 && ok;
+
+	if (!ok || fs_replace(tmp_path, idx_path, 0, NULL) != FS_OK)
+		remove(tmp_path);
+	free(tmp_path);
+}
+
+int
+agenda_index_load_alloc(const char *path, struct fs_map *map,
+                        struct agenda_index **ret_index)
+{
+	struct agenda_index *index = NULL;
+	char *idx_path = NULL;
+	size_t path_count = 0;
+	int r = 0;
+
+	path_count = strlen(path);
+	idx_path = malloc(path_count + sizeof(".idx"));
+	if (idx_path == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	memcpy(idx_path, path, path_count);
+	memcpy(&idx_path[path_count], ".idx", sizeof(".idx"));
+
+	index = malloc(sizeof *index);
+	if (index == NULL)
+	{
+		r = AGENDA_EOOM;
+		goto _done;
+	}
+	index->file_size = 0;
+	index->file_mtime = 0;
+	index->sorted_end = 0;
+	index->sorted_hash = 0;
+	index->day_count = 0;
+	index->day_capacity = 0;
+	index->day_array = NULL;
+
+	r = _read(idx_path, index);
+
+	if (r == AGENDA_OK && index->file_size == map->count &&
+	    index->file_mtime == map->mtime)
+		goto _done;
+
+	/* An agenda that only grew had entries or journal records appended,
+	 * what was indexed still holds. The agenda is edited by hand too, the
+	 * hash of what the index points at catches edits that move it, without
+	 * reading the whole sorted part. Anything else, including an unreadable
+	 * index, is a rebuild. */
+	if (r != AGENDA_OK || index->file_size >= map->count ||
+	    (index->file_size > 0 &&
+	     map->array[index->file_size - 1] != '\n') ||
+	    _covered_hash(index, map->array) != index->sorted_hash)
+	{
+		index->sorted_end = 0;
+		index->day_count = 0;
+		r = _scan(index, map->array, map->count);
+	}
+	else if (index->sorted_end == index->file_size)
+		r = _scan(index, map->array, map->count);
+	else
+		r = AGENDA_OK;
+	if (r != AGENDA_OK)
+		goto _done;
+
+	index->file_size = map->count;
+	index->file_mtime = map->mtime;
+	index->sorted_hash = _covered_hash(index, map->array);
+	_write(idx_path, index);
+
+	r = AGENDA_OK;
+_done:
+	if (r == AGENDA_OK)
+		*ret_index = index;
+	else if (index != NULL)
+		agenda_index_free(index);
+	if (idx_path != NULL)
+		free(idx_path);
+	return r;
+}
+
+void
+agenda_index_find(struct agenda_index *index, daynum from, daynum to,
+                  size_t *ret_start, size_t *ret_end)
+{
+	u64 low = 0;
+	u64 high = 0;
+	u64 mid = 0;
+
+	/* First day >= from. */
+	low = 0;
+	high = index->day_count;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (index->day_array[mid].day < from)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*ret_start = low < index->day_count ? index->day_array[low].offset
+	                                    : index->sorted_end;
+
+	/* First day > to. */
+	high = index->day_count;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (index->day_array[mid].day <= to)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*ret_end = low < index->day_count ? index->day_array[low].offset
+	                                  : index->sorted_end;
+	if (*ret_end < *ret_start)
+		*ret_end = *ret_start;
+}
+
+void
+agenda_index_free(struct agenda_index *index)
+{
+	if (index->day_array != NULL)
+		free(index->day_array);
+	free(index);
+}
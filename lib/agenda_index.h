@@ -0,0 +1,64 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef AGENDA_INDEX_H
+#define AGENDA_INDEX_H
+
+#include "date.h"
+#include "fs.h"
+#include "intdef.h"
+
+/* Byte offset of the first entry of a day in the sorted part of an agenda. */
+struct agenda_index_day
+{
+	daynum day;
+	u32 reserved;
+	u64 offset;
+};
+
+/* Sidecar index of an agenda file, kept in "<path>.idx". Bytes
+ * [0, sorted_end) of the agenda hold entries sorted by date, anything past it
+ * (e.g. the journal) is not indexed. */
+struct agenda_index
+{
+	u64 file_size;
+	i64 file_mtime;
+	u64 sorted_end;
+	/* FNV-1a of the day starts and the end of the sorted part, tells an
+	 * agenda that only grew from one edited in place. */
+	u64 sorted_hash;
+	u64 day_count;
+	u64 day_capacity;
+	struct agenda_index_day *day_array;
+};
+
+#define AGENDA_INDEX_VERSION 4
+
+/* Loads the index of the agenda at `path`, mapped in `map`. A stale index is
+ * extended when the agenda only grew, or rebuilt otherwise, then saved back.
+ * Failing to save is not an error, the index is just rebuilt next time. */
+int agenda_index_load_alloc(const char *path, struct fs_map *map,
+                            struct agenda_index **ret_index);
+
+/* Byte range of the sorted part that holds every entry from `from` to `to`,
+ * both inclusive. */
+void agenda_index_find(struct agenda_index *index, daynum from, daynum to,
+                       size_t *ret_start, size_t *ret_end);
+
+void agenda_index_free(struct agenda_index *index);
+
+#endif /* !AGENDA_INDEX_H */
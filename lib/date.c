@@ -18,16 +18,56 @@
 #include "date.h"
 #include <stddef.h>
 
-/* https://howardhinnant.github.io/date_algorithms.html#civil_from_days */
-void
-weekdate_from_time(time_t time, struct weekdate *ret_date)
+/* Indexed by leap year, then month. */
+static const int _month_days[2][13] = {
+	{ 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+	{ 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+};
+
+static int
+_is_leap(int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/* https://howardhinnant.github.io/date_algorithms.html#days_from_civil */
+daynum
+daynum_from_date(struct date *date)
 {
-	time_t time_tz, z, era, doe, yoe, y, doy, mp, d, m, year, month, day,
-	    week_day;
+	i32 y, m, d, era, yoe, doy, doe;
+
+	y = date->year;
+	m = date->month;
+	d = date->day;
+	if (m <= 2)
+		y -= 1;
+	era = ((y >= 0) ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = ((153 * ((m > 2) ? m - 3 : m + 9) + 2) / 5) + d - 1;
+	doe = yoe * 365 + (yoe / 4) - (yoe / 100) + doy;
+	return era * 146097 + doe - 719468;
+}
+
+daynum
+daynum_from_time(time_t time)
+{
+	time_t time_tz = 0;
+	time_t day = 0;
 
 	time_tz = time + (BRAZIL_TIMEZONE_IN_MINUTES * SECS_PER_MINUTE);
+	day = time_tz / SECS_PER_DAY;
+	if (time_tz % SECS_PER_DAY < 0)
+		day -= 1;
+	return day;
+}
 
-	z = time_tz / SECS_PER_DAY + 719468;
+/* https://howardhinnant.github.io/date_algorithms.html#civil_from_days */
+void
+daynum_to_date(daynum day, struct date *ret_date)
+{
+	i32 z, era, doe, yoe, y, doy, mp, d, m;
+
+	z = day + 719468;
 	era = ((z >= 0) ? z : z - 146096) / 146097;
 	doe = (z - era * 146097);
 	yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
@@ -37,87 +77,190 @@ weekdate_from_time(time_t time, struct weekdate *ret_date)
 	d = doy - (153 * mp + 2) / 5 + 1;
 	m = (mp < 10) ? mp + 3 : mp - 9;
 
-	year = (m <= 2) ? y + 1 : y;
-	month = m;
-	day = d;
-	week_day = 1 + ((z + 3) % 7);
-
-	ret_date->year = year;
-	ret_date->month = month;
-	ret_date->day = day;
-	ret_date->week_day = week_day;
+	ret_date->year = (m <= 2) ? y + 1 : y;
+	ret_date->month = m;
+	ret_date->day = d;
 }
 
 void
-weekdate_from_date(struct date *date, struct weekdate *ret_date)
+daynum_to_weekdate(daynum day, struct weekdate *ret_date)
 {
-	time_t time = 0;
+	struct date date = DATE_ZERO;
 
-	time = date_to_time(date);
-	weekdate_from_time(time, ret_date);
+	daynum_to_date(day, &date);
+	ret_date->year = date.year;
+	ret_date->month = date.month;
+	ret_date->day = date.day;
+	ret_date->week_day = daynum_week_day(day);
 }
 
-void
-weekdate_next(struct weekdate *date)
+/* 1970-01-01 was a thursday. */
+int
+daynum_week_day(daynum day)
 {
-	struct weekdate next = WEEKDATE_ZERO;
+	i32 week_day = 0;
 
-	weekdate_add_days(date, 1, &next);
+	week_day = (day + 4) % 7;
+	if (week_day < 0)
+		week_day += 7;
+	return WEEK_DAY_SUNDAY + week_day;
+}
 
-	date->year = next.year;
-	date->month = next.month;
-	date->day = next.day;
-	date->week_day = next.week_day;
+static daynum
+_year_first_day(int year)
+{
+	struct date date = DATE_ZERO;
+
+	date.year = year;
+	date.month = MONTH_JANUARY;
+	date.day = 1;
+	return daynum_from_date(&date);
 }
 
-/* https://howardhinnant.github.io/date_algorithms.html#days_from_civil */
-time_t
-date_to_time(struct date *date)
+/* Years starting on a thursday, and leap years starting on a wednesday, have
+ * 53 ISO weeks. */
+static int
+_iso_week_count(int year)
 {
-	time_t y, m, d, era, yoe, doy, doe;
+	int week_day = 0;
 
-	y = date->year;
-	m = date->month;
-	d = date->day;
-	if (m <= 2)
-		y -= 1;
-	era = ((y >= 0) ? y : y - 399) / 400;
-	yoe = y - era * 400;
-	if (yoe < 0)
-		yoe *= -1;
-	doy = ((153 * ((m > 2) ? m - 3 : m + 9) + 2) / 5) + d - 1;
-	doe = yoe * 365 + (yoe / 4) - (yoe / 100) + doy;
-	return SECS_PER_DAY * (era * 146097 + doe - 719468);
+	week_day = daynum_week_day(_year_first_day(year));
+	if (week_day == WEEK_DAY_THURSDAY ||
+	    (week_day == WEEK_DAY_WEDNESDAY && _is_leap(year)))
+		return 53;
+	return 52;
+}
+
+static void
+_year_table_build(int year, struct year_table *ret_table)
+{
+	struct year_day *at = NULL;
+	int week_count = 0;
+	int week_count_previous = 0;
+	int week_day = 0;
+	int iso_week_day = 0;
+	int iso_week = 0;
+	int month_last_day = 0;
+	int month = 0;
+	int day = 0;
+	int i = 0;
+
+	ret_table->year = year;
+	ret_table->leap = _is_leap(year);
+	ret_table->first_day = _year_first_day(year);
+	ret_table->day_count = ret_table->leap ? 366 : 365;
+
+	week_count = _iso_week_count(year);
+	week_count_previous = _iso_week_count(year - 1);
+	week_day = daynum_week_day(ret_table->first_day);
+	for (month = MONTH_JANUARY; month <= MONTH_DECEMBER; month++)
+	{
+		month_last_day = _month_days[ret_table->leap][month];
+		for (day = 1; day <= month_last_day; day++, i++)
+		{
+			at = &ret_table->day_array[i];
+			at->month = month;
+			at->day = day;
+			at->week_day = week_day;
+			at->month_last_day = month_last_day;
+			at->negative_day = day - at->month_last_day - 1;
+			at->day_of_year = i + 1;
+			at->nth_week_day = (day - 1) / 7 + 1;
+
+			/* Weeks start on monday and the first one has the
+			 * year's first thursday. */
+			iso_week_day = (week_day == WEEK_DAY_SUNDAY)
+			                   ? 7
+			                   : week_day - WEEK_DAY_SUNDAY;
+			iso_week = (i + 1 - iso_week_day + 10) / 7;
+			if (iso_week < 1)
+				iso_week = week_count_previous;
+			else if (iso_week > week_count)
+				iso_week = 1;
+			at->iso_week = iso_week;
+
+			if (week_day == WEEK_DAY_SATURDAY)
+				week_day = WEEK_DAY_SUNDAY;
+			else
+				week_day += 1;
+		}
+	}
 }
 
 void
-weekdate_add_days(struct weekdate *date, int days, struct weekdate *ret_date)
+calendar_init(struct calendar *cal, daynum day)
 {
-	int new_day = 0;
-	int new_month = 0;
-	int new_year = 0;
-	int last_day_of_month = 0;
-	int new_week_day = 0;
-
-	new_day = date->day + days;
-	new_week_day = 1 + ((date->week_day + days - 1) % 7);
-	new_month = date->month;
-	new_year = date->year;
-	last_day_of_month = date_month_last_day(new_year, new_month);
-	while (new_day > last_day_of_month)
+	struct year_table *table = NULL;
+	struct date date = DATE_ZERO;
+	int i = 0;
+
+	for (i = 0; i < 2; i++)
 	{
-		new_day -= last_day_of_month;
-		new_month = (new_month % 12) + 1;
-		if (new_month == MONTH_JANUARY)
-			new_year += 1;
+		table = &cal->table_array[i];
+		if (table->day_count != 0 && day >= table->first_day &&
+		    day - table->first_day < table->day_count)
+			goto _found;
+	}
+
+	daynum_to_date(day, &date);
+	table = &cal->table_array[date.year & 1];
+	_year_table_build(date.year, table);
+
+_found:
+	cal->day = day;
+	cal->table = table;
+	cal->at = &table->day_array[day - table->first_day];
+}
+
+void
+calendar_next(struct calendar *cal)
+{
+	cal->day += 1;
+	if (cal->at + 1 < &cal->table->day_array[cal->table->day_count])
+		cal->at += 1;
+	else
+		calendar_init(cal, cal->day);
+}
+
+void
+calendar_jump(struct calendar *cal, int days)
+{
+	daynum index = 0;
 
-		last_day_of_month = date_month_last_day(new_year, new_month);
+	index = cal->day + days - cal->table->first_day;
+	if (index < 0 || index >= cal->table->day_count)
+	{
+		calendar_init(cal, cal->day + days);
+		return;
 	}
 
-	ret_date->year = new_year;
-	ret_date->month = new_month;
-	ret_date->day = new_day;
-	ret_date->week_day = new_week_day;
+	cal->day += days;
+	cal->at = &cal->table->day_array[index];
+}
+
+void
+weekdate_from_time(time_t time, struct weekdate *ret_date)
+{
+	daynum_to_weekdate(daynum_from_time(time), ret_date);
+}
+
+void
+weekdate_from_date(struct date *date, struct weekdate *ret_date)
+{
+	daynum_to_weekdate(daynum_from_date(date), ret_date);
+}
+
+time_t
+date_to_time(struct date *date)
+{
+	return (time_t)daynum_from_date(date) * SECS_PER_DAY;
+}
+
+void
+weekdate_add_days(struct weekdate *date, int days, struct weekdate *ret_date)
+{
+	daynum_to_weekdate(daynum_from_date((struct date *)date) + days,
+	                   ret_date);
 }
 
 int
@@ -180,28 +323,9 @@ weekdate_week_day_string(int week_day)
 int
 date_month_last_day(int year, int month)
 {
-	switch (month)
-	{
-		case MONTH_JANUARY:
-		case MONTH_MARCH:
-		case MONTH_MAY:
-		case MONTH_JULY:
-		case MONTH_AUGUST:
-		case MONTH_OCTOBER:
-		case MONTH_DECEMBER:
-			return 31;
-
-		case MONTH_APRIL:
-		case MONTH_JUNE:
-		case MONTH_SEPTEMBER:
-		case MONTH_NOVEMBER:
-			return 30;
-
-		case MONTH_FEBRUARY:
-			return (year % 4 == 0 && year % 100 != 0) ? 29 : 28;
-	}
-
-	return -1;
+	if (month < MONTH_JANUARY || month > MONTH_DECEMBER)
+		return -1;
+	return _month_days[_is_leap(year)][month];
 }
 
 void
@@ -217,3 +341,56 @@ date_fprintf(FILE *fd, struct date *date)
 	else
 		fprintf(fd, "%d", date->day);
 }
+
+/* Same output as `date_fprintf`, returns how many chars were written. */
+int
+date_format(char *buffer, struct date *date)
+{
+	char digits[10];
+	unsigned int year = 0;
+	int count = 0;
+	int i = 0;
+
+	if (date->year < 0)
+	{
+		buffer[count++] = '-';
+		year = -(unsigned int)date->year;
+	}
+	else
+		year = date->year;
+
+	do
+	{
+		digits[i++] = '0' + year % 10;
+		year /= 10;
+	} while (year != 0);
+	while (i > 0)
+		buffer[count++] = digits[--i];
+
+	buffer[count++] = '-';
+	buffer[count++] = '0' + (date->month / 10) % 10;
+	buffer[count++] = '0' + date->month % 10;
+	buffer[count++] = '-';
+	buffer[count++] = '0' + (date->day / 10) % 10;
+	buffer[count++] = '0' + date->day % 10;
+
+	return count;
+}
+
+void
+daynum_fprintf(FILE *fd, daynum day)
+{
+	struct date date = DATE_ZERO;
+
+	daynum_to_date(day, &date);
+	date_fprintf(fd, &date);
+}
+
+int
+daynum_format(char *buffer, daynum day)
+{
+	struct date date = DATE_ZERO;
+
+	daynum_to_date(day, &date);
+	return date_format(buffer, &date);
+}
@@ -18,6 +18,7 @@
 #ifndef DATE_H
 #define DATE_H
 
+#include "intdef.h"
 #include <stdio.h> /* IWYU pragma: keep ... FILE* */
 #include <time.h>  /* IWYU pragma: keep ... time_t */
 
@@ -70,14 +71,87 @@ struct weekdate
 #define DATE_ZERO     { 0, 0, 0 }
 #define WEEKDATE_ZERO { 0, 0, 0, 0 }
 
+/* Days since 1970-01-01, negative before it. Dates compare as integers and
+ * adding N days is adding N. */
+typedef i32 daynum;
+
+daynum daynum_from_date(struct date *date);
+/* Date of `time` at BRAZIL_TIMEZONE_IN_MINUTES. */
+daynum daynum_from_time(time_t time);
+void daynum_to_date(daynum day, struct date *ret_date);
+void daynum_to_weekdate(daynum day, struct weekdate *ret_date);
+/* WEEK_DAY_SUNDAY to WEEK_DAY_SATURDAY */
+int daynum_week_day(daynum day);
+void daynum_fprintf(FILE *fd, daynum day);
+int daynum_format(char *buffer, daynum day);
+
+#define DAYNUM_MIN (-2147483647 - 1)
+#define DAYNUM_MAX 2147483647
+
+/* Years whose every day fits in a daynum, with room left for the arithmetic
+ * of `daynum_from_date` and `daynum_to_date`. */
+#define DATE_YEAR_MIN (-5877000)
+#define DATE_YEAR_MAX 5879000
+
+/* What rules look at for one day of a year. */
+struct year_day
+{
+	u8 month;
+	u8 day;
+	u8 week_day;
+	u8 month_last_day;
+	/* ISO 8601, 1 to 53. May belong to the previous or next year. */
+	u8 iso_week;
+	/* 1 for the first of its week day in the month, e.g. the first
+	 * friday, 2 for the second, ... */
+	u8 nth_week_day;
+	/* -1 on the last day of the month, -2 on the day before, ... */
+	i16 negative_day;
+	/* 1 to 366. */
+	u16 day_of_year;
+};
+
+struct year_table
+{
+	int year;
+	int leap;
+	daynum first_day;
+	/* 0 while the table isn't built. */
+	int day_count;
+	struct year_day day_array[366];
+};
+
+/* Cursor over consecutive days. `at` points into a table built the first
+ * time the cursor enters a year, so stepping is an increment and a compare.
+ * It points into the cursor itself, don't copy one. */
+struct calendar
+{
+	daynum day;
+	const struct year_table *table;
+	const struct year_day *at;
+	/* Indexed by year parity, walking back and forth over a new year
+	 * doesn't rebuild either table. */
+	struct year_table table_array[2];
+};
+
+#define CALENDAR_ZERO { 0 }
+
+void calendar_init(struct calendar *cal, daynum day);
+void calendar_next(struct calendar *cal);
+/* `days` may be negative. */
+void calendar_jump(struct calendar *cal, int days);
+
 void weekdate_from_time(time_t time, struct weekdate *ret_date);
 void weekdate_from_date(struct date *date, struct weekdate *ret_date);
 const char *weekdate_week_day_string(int week_day);
 void weekdate_add_days(struct weekdate *date, int days,
                        struct weekdate *ret_date);
-void weekdate_next(struct weekdate *date);
+
+/* Room for the longest output of `date_format`, e.g. "-2147483648-12-31". */
+#define DATE_FORMAT_MAX 18
 
 void date_fprintf(FILE *fd, struct date *date);
+int date_format(char *buffer, struct date *date);
 time_t date_to_time(struct date *date);
 int date_negative_day(struct date *date);
 int date_compare(const struct date *a, const struct date *b);
@@ -78,6 +78,33 @@ struct db_migration db_migrations[] = {
 	  "last_run_at_timestamp INT"
 	  ");" },
 
+	{ "20261017120000_scheduler_rule_blob.sql",
+	  /* Compiled form of `rule`, see rule_load_alloc */
+	  "ALTER TABLE scheduler ADD COLUMN rule_blob BLOB;"
+	  "ALTER TABLE scheduler ADD COLUMN rule_blob_version INT;"
+	  /* Changing the text drops its compiled form */
+	  "CREATE TRIGGER scheduler_rule_blob_update "
+	  "AFTER UPDATE OF rule ON scheduler "
+	  "BEGIN "
+	  "UPDATE scheduler SET rule_blob=NULL,rule_blob_version=NULL "
+	  "WHERE id=NEW.id;"
+	  "END;" },
+
+	{ "20261017120100_agenda_scheduler_due_unique.sql",
+	  /* Keep the oldest of each duplicated scheduler entry, entries added
+	   * by hand have no scheduler and are left alone */
+	  "DELETE FROM agenda WHERE scheduler_id IS NOT NULL AND id NOT IN("
+	  "SELECT MIN(id) FROM agenda WHERE scheduler_id IS NOT NULL "
+	  "GROUP BY scheduler_id,due_at"
+	  ");"
+	  /* A scheduler puts at most one entry on each day */
+	  "CREATE UNIQUE INDEX agenda_scheduler_due "
+	  "ON agenda(scheduler_id,due_at);" },
+
+	{ "20261017120200_agenda_due.sql",
+	  /* Listing walks the agenda by due date */
+	  "CREATE INDEX agenda_due ON agenda(due_at);" },
+
 	{ NULL, NULL }
 };
 
@@ -0,0 +1,109 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "db_stmt_cache.h"
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+db_stmt_cache_init(struct db_stmt_cache *cache, sqlite3 *db)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->db = db;
+}
+
+int
+db_stmt_cache_get(struct db_stmt_cache *cache, const char *sql,
+                  sqlite3_stmt **ret_stmt)
+{
+	struct db_stmt_cache_entry *entry = NULL;
+	struct db_stmt_cache_entry *new_array = NULL;
+	sqlite3_stmt *stmt = NULL;
+	usize new_capacity = 0;
+	usize i = 0;
+	int r = 0;
+
+	for (i = 0; i < cache->entry_count; i++)
+	{
+		entry = &cache->entry_array[i];
+		if (entry->sql == sql || strcmp(entry->sql, sql) == 0)
+		{
+			cache->reuse_count++;
+			*ret_stmt = entry->stmt;
+			r = DB_STMT_CACHE_OK;
+			goto _done;
+		}
+	}
+
+	if (cache->entry_count == cache->entry_capacity)
+	{
+		new_capacity = cache->entry_capacity * 2 + 16;
+		new_array = realloc(cache->entry_array,
+		                    sizeof *new_array * new_capacity);
+		if (new_array == NULL)
+		{
+			r = DB_STMT_CACHE_EOOM;
+			goto _done;
+		}
+
+		cache->entry_capacity = new_capacity;
+		cache->entry_array = new_array;
+	}
+
+	r = sqlite3_prepare_v3(cache->db, sql, -1, SQLITE_PREPARE_PERSISTENT,
+	                       &stmt, NULL);
+	if (r != SQLITE_OK)
+	{
+		if (stmt != NULL)
+			sqlite3_finalize(stmt);
+		r = DB_STMT_CACHE_E;
+		goto _done;
+	}
+
+	entry = &cache->entry_array[cache->entry_count++];
+	entry->sql = sql;
+	entry->stmt = stmt;
+	cache->prepare_count++;
+
+	*ret_stmt = stmt;
+
+	r = DB_STMT_CACHE_OK;
+_done:
+	return r;
+}
+
+void
+db_stmt_cache_release(sqlite3_stmt *stmt)
+{
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+}
+
+void
+db_stmt_cache_finalize(struct db_stmt_cache *cache)
+{
+	usize i = 0;
+
+	for (i = 0; i < cache->entry_count; i++)
+		sqlite3_finalize(cache->entry_array[i].stmt);
+	if (cache->entry_array != NULL)
+		free(cache->entry_array);
+	cache->entry_count = 0;
+	cache->entry_capacity = 0;
+	cache->entry_array = NULL;
+}
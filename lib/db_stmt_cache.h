@@ -0,0 +1,66 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DB_STMT_CACHE_H
+#define DB_STMT_CACHE_H
+
+#include "intdef.h"
+#include <sqlite3.h>
+
+enum
+{
+	DB_STMT_CACHE_OK = 0,
+	DB_STMT_CACHE_E,
+	DB_STMT_CACHE_EOOM
+};
+
+struct db_stmt_cache_entry
+{
+	const char *sql;
+	sqlite3_stmt *stmt;
+};
+
+/* Statements of one connection, each prepared once and reused for as long
+ * as the connection is open. */
+struct db_stmt_cache
+{
+	sqlite3 *db;
+	usize entry_count;
+	usize entry_capacity;
+	struct db_stmt_cache_entry *entry_array;
+	/* Statements prepared, and times one was reused instead. */
+	usize prepare_count;
+	usize reuse_count;
+};
+
+#define DB_STMT_CACHE_ZERO { 0 }
+
+void db_stmt_cache_init(struct db_stmt_cache *cache, sqlite3 *db);
+
+/* ERROR | EOOM | OK. Statement for `sql`, prepared on its first use. `sql`
+ * must outlive the cache. Hand it back with db_stmt_cache_release. */
+int db_stmt_cache_get(struct db_stmt_cache *cache, const char *sql,
+                      sqlite3_stmt **ret_stmt);
+
+/* Resets `stmt` and clears its bindings, ready for the next get. */
+void db_stmt_cache_release(sqlite3_stmt *stmt);
+
+/* Finalizes every statement and frees the cache, must come before closing
+ * the connection. */
+void db_stmt_cache_finalize(struct db_stmt_cache *cache);
+
+#endif /* !DB_STMT_CACHE_H */
@@ -0,0 +1,76 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FS_H
+#define FS_H
+
+#include "intdef.h"
+#include <stddef.h>
+#include <stdio.h>
+
+enum
+{
+	FS_OK = 0,
+	FS_EOOM,
+	FS_EACCES,
+	FS_ENOENT,
+	FS_EERRNO
+};
+
+/* Read-only view of a whole file. `array` is NULL when the file is empty.
+ * `mtime` is the modification time in nanoseconds, only good for comparing. */
+struct fs_map
+{
+	const char *array;
+	size_t count;
+	i64 mtime;
+	void *handle;
+};
+
+#define FS_MAP_ZERO { NULL, 0, 0, NULL }
+
+int fs_map(const char *path, struct fs_map *ret_map, int *reterr_errno);
+
+void fs_unmap(struct fs_map *map);
+
+/* Reads up to `count` bytes from the start of the file in a single call,
+ * `ret_count` is how many were read. For small files read on hot paths,
+ * where mapping costs more than copying. */
+int fs_read(const char *path, void *array, size_t count, size_t *ret_count,
+            int *reterr_errno);
+
+/* Blocks until `fd` holds an exclusive advisory lock on its file, released
+ * by fclose. Only other `fs_lock` callers wait on it. */
+int fs_lock(FILE *fd, int *reterr_errno);
+
+/* Cuts the file behind `fd` down to `size` bytes. */
+int fs_truncate(FILE *fd, u64 size, int *reterr_errno);
+
+/* Flushes `fd` all the way to the disk. */
+int fs_sync(FILE *fd, int *reterr_errno);
+
+/* Creates a file with a name no one else uses, next to `path` so it can
+ * replace it with `fs_replace`, and with the permissions `path` has, if it
+ * exists. `ret_tmp_path` is for `fs_replace` or remove(3), then free(3). */
+int fs_temp_open(const char *path, FILE **ret_fd, char **ret_tmp_path,
+                 int *reterr_errno);
+
+/* Atomically replaces `to` with `from`. With `sync` set, also makes the
+ * rename itself durable. */
+int fs_replace(const char *from, const char *to, int sync, int *reterr_errno);
+
+#endif /* !FS_H */
@@ -0,0 +1,335 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int
+fs_map(const char *path, struct fs_map *ret_map, int *reterr_errno)
+{
+	struct stat sb = { 0 };
+	void *array = NULL;
+	int fd = -1;
+	int r = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		switch (errno)
+		{
+			case EACCES:
+				r = FS_EACCES;
+				goto _done;
+
+			case ENOENT:
+				r = FS_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				r = FS_EERRNO;
+				goto _done;
+		}
+	}
+
+	if (fstat(fd, &sb) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	/* mmap refuses zero length mappings, an empty file is just empty. */
+	if (sb.st_size > 0)
+	{
+		array = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (array == MAP_FAILED)
+		{
+			if (reterr_errno != NULL)
+				*reterr_errno = errno;
+			r = FS_EERRNO;
+			goto _done;
+		}
+	}
+
+	ret_map->array = array;
+	ret_map->count = sb.st_size;
+	ret_map->mtime =
+	    (i64)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+	ret_map->handle = NULL;
+	r = FS_OK;
+_done:
+	/* The mapping keeps its own reference to the file. */
+	if (fd != -1)
+		close(fd);
+	return r;
+}
+
+void
+fs_unmap(struct fs_map *map)
+{
+	if (map->array != NULL)
+		munmap((void *)map->array, map->count);
+	map->array = NULL;
+	map->count = 0;
+	map->mtime = 0;
+	map->handle = NULL;
+}
+
+static int
+_open_error(int *reterr_errno)
+{
+	switch (errno)
+	{
+		case EACCES:
+			return FS_EACCES;
+
+		case ENOENT:
+			return FS_ENOENT;
+
+		default:
+			if (reterr_errno != NULL)
+				*reterr_errno = errno;
+			return FS_EERRNO;
+	}
+}
+
+int
+fs_read(const char *path, void *array, size_t count, size_t *ret_count,
+        int *reterr_errno)
+{
+	ssize_t read_count = 0;
+	int fd = -1;
+	int r = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		r = _open_error(reterr_errno);
+		goto _done;
+	}
+
+	read_count = pread(fd, array, count, 0);
+	if (read_count < 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	*ret_count = read_count;
+	r = FS_OK;
+_done:
+	if (fd != -1)
+		close(fd);
+	return r;
+}
+
+int
+fs_lock(FILE *fd, int *reterr_errno)
+{
+	while (flock(fileno(fd), LOCK_EX) != 0)
+	{
+		if (errno == EINTR)
+			continue;
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_truncate(FILE *fd, u64 size, int *reterr_errno)
+{
+	if (fflush(fd) != 0 || ftruncate(fileno(fd), (off_t)size) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_sync(FILE *fd, int *reterr_errno)
+{
+	if (fflush(fd) != 0 || fsync(fileno(fd)) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_temp_open(const char *path, FILE **ret_fd, char **ret_tmp_path,
+             int *reterr_errno)
+{
+	struct stat sb = { 0 };
+	char *tmp_path = NULL;
+	size_t path_count = 0;
+	mode_t mask = 0;
+	mode_t mode = 0;
+	int fd = -1;
+	int r = 0;
+
+	path_count = strlen(path);
+	tmp_path = malloc(path_count + sizeof(".XXXXXX"));
+	if (tmp_path == NULL)
+	{
+		r = FS_EOOM;
+		goto _done;
+	}
+	memcpy(tmp_path, path, path_count);
+	memcpy(&tmp_path[path_count], ".XXXXXX", sizeof(".XXXXXX"));
+
+	fd = mkstemp(tmp_path);
+	if (fd == -1)
+	{
+		r = _open_error(reterr_errno);
+		goto _done;
+	}
+
+	/* mkstemp makes it private to us, give it what `path` has or what a
+	 * new file would get. */
+	if (stat(path, &sb) == 0)
+	{
+		mode = sb.st_mode & 07777;
+	}
+	else
+	{
+		mask = umask(0);
+		umask(mask);
+		mode = 0666 & ~mask;
+	}
+	if (fchmod(fd, mode) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	*ret_fd = fdopen(fd, "wb");
+	if (*ret_fd == NULL)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = FS_EERRNO;
+		goto _done;
+	}
+	fd = -1;
+
+	*ret_tmp_path = tmp_path;
+	tmp_path = NULL;
+	r = FS_OK;
+_done:
+	if (fd != -1)
+	{
+		close(fd);
+		remove(tmp_path);
+	}
+	if (tmp_path != NULL)
+		free(tmp_path);
+	return r;
+}
+
+int
+fs_replace(const char *from, const char *to, int sync, int *reterr_errno)
+{
+	char dir_path[PATH_MAX];
+	const char *slash = NULL;
+	size_t len = 0;
+	int dir_fd = -1;
+	int r = 0;
+
+	if (rename(from, to) != 0)
+	{
+		switch (errno)
+		{
+			case EACCES:
+				r = FS_EACCES;
+				goto _done;
+
+			case ENOENT:
+				r = FS_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = errno;
+				r = FS_EERRNO;
+				goto _done;
+		}
+	}
+
+	if (!sync)
+	{
+		r = FS_OK;
+		goto _done;
+	}
+
+	/* The new name is only durable once its directory is. */
+	slash = strrchr(to, '/');
+	if (slash == NULL)
+		strcpy(dir_path, ".");
+	else
+	{
+		len = slash == to ? 1 : (size_t)(slash - to);
+		if (len >= PATH_MAX)
+		{
+			r = FS_ENOENT;
+			goto _done;
+		}
+		memcpy(dir_path, to, len);
+		dir_path[len] = '\0';
+	}
+
+	dir_fd = open(dir_path, O_RDONLY);
+	if (dir_fd == -1 || fsync(dir_fd) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = errno;
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	r = FS_OK;
+_done:
+	if (dir_fd != -1)
+		close(dir_fd);
+	return r;
+}
@@ -0,0 +1,328 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "fs.h"
+#include <io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+int
+fs_map(const char *path, struct fs_map *ret_map, int *reterr_errno)
+{
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	LARGE_INTEGER size;
+	FILETIME mtime;
+	void *array = NULL;
+	int r = 0;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		switch (GetLastError())
+		{
+			case ERROR_ACCESS_DENIED:
+				r = FS_EACCES;
+				goto _done;
+
+			case ERROR_FILE_NOT_FOUND:
+			case ERROR_PATH_NOT_FOUND:
+				r = FS_ENOENT;
+				goto _done;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = GetLastError();
+				r = FS_EERRNO;
+				goto _done;
+		}
+	}
+
+	if (!GetFileSizeEx(file, &size))
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	if (!GetFileTime(file, NULL, NULL, &mtime))
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	if (size.QuadPart > 0)
+	{
+		mapping =
+		    CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			if (reterr_errno != NULL)
+				*reterr_errno = GetLastError();
+			r = FS_EERRNO;
+			goto _done;
+		}
+
+		array = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (array == NULL)
+		{
+			if (reterr_errno != NULL)
+				*reterr_errno = GetLastError();
+			r = FS_EERRNO;
+			goto _done;
+		}
+	}
+
+	ret_map->array = array;
+	ret_map->count = size.QuadPart;
+	/* FILETIME counts 100 nanosecond intervals. */
+	ret_map->mtime =
+	    (((i64)mtime.dwHighDateTime << 32) | mtime.dwLowDateTime) * 100;
+	ret_map->handle = mapping;
+	mapping = NULL;
+	r = FS_OK;
+_done:
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	return r;
+}
+
+void
+fs_unmap(struct fs_map *map)
+{
+	if (map->array != NULL)
+		UnmapViewOfFile(map->array);
+	if (map->handle != NULL)
+		CloseHandle(map->handle);
+	map->array = NULL;
+	map->count = 0;
+	map->mtime = 0;
+	map->handle = NULL;
+}
+
+static int
+_open_error(int *reterr_errno)
+{
+	switch (GetLastError())
+	{
+		case ERROR_ACCESS_DENIED:
+			return FS_EACCES;
+
+		case ERROR_FILE_NOT_FOUND:
+		case ERROR_PATH_NOT_FOUND:
+			return FS_ENOENT;
+
+		default:
+			if (reterr_errno != NULL)
+				*reterr_errno = GetLastError();
+			return FS_EERRNO;
+	}
+}
+
+int
+fs_read(const char *path, void *array, size_t count, size_t *ret_count,
+        int *reterr_errno)
+{
+	HANDLE file = INVALID_HANDLE_VALUE;
+	DWORD read_count = 0;
+	int r = 0;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		r = _open_error(reterr_errno);
+		goto _done;
+	}
+
+	if (!ReadFile(file, array, (DWORD)count, &read_count, NULL))
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	*ret_count = read_count;
+	r = FS_OK;
+_done:
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	return r;
+}
+
+int
+fs_lock(FILE *fd, int *reterr_errno)
+{
+	OVERLAPPED overlapped;
+	HANDLE file = INVALID_HANDLE_VALUE;
+
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	file = (HANDLE)_get_osfhandle(_fileno(fd));
+	if (file == INVALID_HANDLE_VALUE ||
+	    !LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD,
+	                &overlapped))
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_truncate(FILE *fd, u64 size, int *reterr_errno)
+{
+	errno_t err = 0;
+
+	if (fflush(fd) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		return FS_EERRNO;
+	}
+
+	err = _chsize_s(_fileno(fd), (__int64)size);
+	if (err != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = err;
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_sync(FILE *fd, int *reterr_errno)
+{
+	if (fflush(fd) != 0 || _commit(_fileno(fd)) != 0)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		return FS_EERRNO;
+	}
+
+	return FS_OK;
+}
+
+int
+fs_temp_open(const char *path, FILE **ret_fd, char **ret_tmp_path,
+             int *reterr_errno)
+{
+	char dir_path[MAX_PATH];
+	char *tmp_path = NULL;
+	const char *slash = NULL;
+	size_t dir_count = 0;
+	DWORD attributes = 0;
+	int r = 0;
+
+	tmp_path = malloc(MAX_PATH);
+	if (tmp_path == NULL)
+	{
+		r = FS_EOOM;
+		goto _done;
+	}
+
+	slash = strrchr(path, '\\');
+	if (strrchr(path, '/') > slash)
+		slash = strrchr(path, '/');
+	dir_count = (slash == NULL) ? 0 : (size_t)(slash - path) + 1;
+	if (dir_count >= MAX_PATH)
+	{
+		r = FS_ENOENT;
+		goto _done;
+	}
+	if (dir_count == 0)
+		dir_path[dir_count++] = '.';
+	else
+		memcpy(dir_path, path, dir_count);
+	dir_path[dir_count] = '\0';
+
+	/* Creates the file, so the name stays ours. */
+	if (GetTempFileNameA(dir_path, "ys", 0, tmp_path) == 0)
+	{
+		r = _open_error(reterr_errno);
+		goto _done;
+	}
+
+	/* Windows has no mode bits, carry over the attributes that say how
+	 * the file is shown and indexed. */
+	attributes = GetFileAttributesA(path);
+	if (attributes != INVALID_FILE_ATTRIBUTES)
+	{
+		attributes &= FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM |
+		              FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+		SetFileAttributesA(tmp_path, attributes);
+	}
+
+	*ret_fd = fopen(tmp_path, "wb");
+	if (*ret_fd == NULL)
+	{
+		if (reterr_errno != NULL)
+			*reterr_errno = GetLastError();
+		remove(tmp_path);
+		r = FS_EERRNO;
+		goto _done;
+	}
+
+	*ret_tmp_path = tmp_path;
+	tmp_path = NULL;
+	r = FS_OK;
+_done:
+	if (tmp_path != NULL)
+		free(tmp_path);
+	return r;
+}
+
+int
+fs_replace(const char *from, const char *to, int sync, int *reterr_errno)
+{
+	DWORD flags = MOVEFILE_REPLACE_EXISTING;
+
+	if (sync)
+		flags |= MOVEFILE_WRITE_THROUGH;
+
+	if (!MoveFileExA(from, to, flags))
+	{
+		switch (GetLastError())
+		{
+			case ERROR_ACCESS_DENIED:
+				return FS_EACCES;
+
+			case ERROR_FILE_NOT_FOUND:
+			case ERROR_PATH_NOT_FOUND:
+				return FS_ENOENT;
+
+			default:
+				if (reterr_errno != NULL)
+					*reterr_errno = GetLastError();
+				return FS_EERRNO;
+		}
+	}
+
+	return FS_OK;
+}
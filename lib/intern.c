@@ -0,0 +1,227 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define _SLOT_CAPACITY_MIN 64
+
+/* FNV-1a */
+static u32
+_hash(const char *array, size_t count)
+{
+	u32 hash = 2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		hash ^= (unsigned char)array[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Slots are kept at most half full, the string array grows along. */
+static int
+_grow(struct intern *intern)
+{
+	struct intern_slot *slot_array = NULL;
+	struct str **str_array = NULL;
+	size_t capacity = 0;
+	size_t mask = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	capacity = intern->slot_capacity * 2;
+	mask = capacity - 1;
+
+	str_array = realloc(intern->str_array, sizeof *str_array * capacity / 2);
+	if (str_array == NULL)
+		return INTERN_EOOM;
+	intern->str_array = str_array;
+
+	slot_array = calloc(capacity, sizeof *slot_array);
+	if (slot_array == NULL)
+		return INTERN_EOOM;
+
+	for (i = 0; i < intern->slot_capacity; i++)
+	{
+		if (intern->slot_array[i].id_1 == 0)
+			continue;
+		for (j = intern->slot_array[i].hash & mask;
+		     slot_array[j].id_1 != 0; j = (j + 1) & mask)
+			;
+		slot_array[j] = intern->slot_array[i];
+	}
+
+	free(intern->slot_array);
+	intern->slot_array = slot_array;
+	intern->slot_capacity = capacity;
+	return INTERN_OK;
+}
+
+int
+intern_alloc(struct intern **ret_intern)
+{
+	struct intern *intern = NULL;
+	int r = 0;
+
+	intern = malloc(sizeof *intern);
+	if (intern == NULL)
+	{
+		r = INTERN_EOOM;
+		goto _done;
+	}
+	intern->count = 0;
+	intern->slot_capacity = _SLOT_CAPACITY_MIN;
+	intern->str_array = NULL;
+
+	intern->slot_array =
+	    calloc(intern->slot_capacity, sizeof *intern->slot_array);
+	if (intern->slot_array == NULL)
+	{
+		r = INTERN_EOOM;
+		goto _done;
+	}
+
+	intern->str_array =
+	    malloc(sizeof *intern->str_array * intern->slot_capacity / 2);
+	if (intern->str_array == NULL)
+	{
+		r = INTERN_EOOM;
+		goto _done;
+	}
+
+	r = INTERN_OK;
+	*ret_intern = intern;
+_done:
+	if (r != INTERN_OK && intern != NULL)
+		intern_free(intern);
+	return r;
+}
+
+/* Index of the slot of `array`, or of the empty one where it belongs. */
+static size_t
+_find(struct intern *intern, const char *array, size_t count, u32 hash)
+{
+	struct intern_slot *slot = NULL;
+	struct str *str = NULL;
+	size_t mask = 0;
+	size_t i = 0;
+
+	mask = intern->slot_capacity - 1;
+	for (i = hash & mask; intern->slot_array[i].id_1 != 0;
+	     i = (i + 1) & mask)
+	{
+		slot = &intern->slot_array[i];
+		if (slot->hash != hash)
+			continue;
+		str = intern->str_array[slot->id_1 - 1];
+		if (str->count == count && memcmp(str->array, array, count) == 0)
+			break;
+	}
+
+	return i;
+}
+
+int
+intern_get(struct intern *intern, const char *array, size_t count,
+           u32 *ret_id)
+{
+	size_t i = 0;
+
+	i = _find(intern, array, count, _hash(array, count));
+	if (intern->slot_array[i].id_1 == 0)
+		return INTERN_ENOENT;
+
+	*ret_id = intern->slot_array[i].id_1 - 1;
+	return INTERN_OK;
+}
+
+int
+intern_put(struct intern *intern, const char *array, size_t count,
+           u32 *ret_id)
+{
+	struct str *str = NULL;
+	size_t mask = 0;
+	size_t i = 0;
+	u32 hash = 0;
+
+	hash = _hash(array, count);
+	i = _find(intern, array, count, hash);
+	if (intern->slot_array[i].id_1 != 0)
+	{
+		*ret_id = intern->slot_array[i].id_1 - 1;
+		return INTERN_OK;
+	}
+
+	if (intern->count + 1 > intern->slot_capacity / 2)
+	{
+		if (_grow(intern) != INTERN_OK)
+			return INTERN_EOOM;
+		mask = intern->slot_capacity - 1;
+		for (i = hash & mask; intern->slot_array[i].id_1 != 0;
+		     i = (i + 1) & mask)
+			;
+	}
+
+	if (str_slice_alloc(array, count, &str) != STR_OK)
+		return INTERN_EOOM;
+
+	intern->str_array[intern->count] = str;
+	intern->count++;
+	intern->slot_array[i].hash = hash;
+	intern->slot_array[i].id_1 = intern->count;
+	*ret_id = intern->count - 1;
+	return INTERN_OK;
+}
+
+int
+intern_put_str(struct intern *intern, const char *array, size_t count,
+               struct str **ret_str)
+{
+	u32 id = 0;
+
+	if (intern_put(intern, array, count, &id) != INTERN_OK)
+		return INTERN_EOOM;
+	*ret_str = intern->str_array[id];
+	return INTERN_OK;
+}
+
+struct str *
+intern_str(struct intern *intern, u32 id)
+{
+	return intern->str_array[id];
+}
+
+void
+intern_free(struct intern *intern)
+{
+	size_t i = 0;
+
+	if (intern->str_array != NULL)
+	{
+		for (i = 0; i < intern->count; i++)
+			str_free(intern->str_array[i]);
+		free(intern->str_array);
+	}
+	if (intern->slot_array != NULL)
+		free(intern->slot_array);
+	free(intern);
+}
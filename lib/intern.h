@@ -0,0 +1,67 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "intdef.h"
+#include "str.h"
+
+/* `id` + 1, 0 = empty slot. */
+struct intern_slot
+{
+	u32 hash;
+	u32 id_1;
+};
+
+/* Keeps one copy of each distinct string. Ids are small and dense, in the
+ * order strings were first seen, so two strings of the same table are equal
+ * iff their ids, or their `struct str *`, are. */
+struct intern
+{
+	size_t count;
+	size_t slot_capacity;
+	struct intern_slot *slot_array;
+	struct str **str_array;
+};
+
+enum
+{
+	INTERN_OK,
+	INTERN_EOOM,
+	INTERN_ENOENT
+};
+
+int intern_alloc(struct intern **ret_intern);
+
+int intern_put(struct intern *intern, const char *array, size_t count,
+               u32 *ret_id);
+
+/* OK | ENOENT. Id of a string already in `intern`, nothing is added. */
+int intern_get(struct intern *intern, const char *array, size_t count,
+               u32 *ret_id);
+
+/* Same as `intern_put`, but returns the shared string. It is owned by
+ * `intern` and valid until `intern_free`. */
+int intern_put_str(struct intern *intern, const char *array, size_t count,
+                   struct str **ret_str);
+
+struct str *intern_str(struct intern *intern, u32 id);
+
+void intern_free(struct intern *intern);
+
+#endif /* !INTERN_H */
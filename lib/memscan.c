@@ -0,0 +1,147 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "memscan.h"
+#include <string.h>
+
+/* Vector paths are picked at compile time, e.g. -mavx2 enables the 32 bytes
+ * one. Without SSE2 a word at a time SWAR loop is used. */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define _MEMSCAN_AVX2
+#define _MEMSCAN_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _MEMSCAN_SSE2
+#endif
+
+#if defined(_MEMSCAN_SSE2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* Index of the lowest set bit, `mask` must not be 0. */
+static unsigned
+_ctz(unsigned mask)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+	unsigned long index = 0;
+
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	unsigned index = 0;
+
+	for (; (mask & 1) == 0; mask >>= 1)
+		index++;
+	return index;
+#endif
+}
+#endif
+
+size_t
+memscan_byte(const char *array, size_t count, char c)
+{
+	size_t i = 0;
+#if defined(_MEMSCAN_AVX2)
+	__m256i c32 = _mm256_set1_epi8(c);
+#endif
+#if defined(_MEMSCAN_SSE2)
+	__m128i c16 = _mm_set1_epi8(c);
+	unsigned mask = 0;
+#else
+	unsigned long ones = ~0UL / 0xFF;
+	unsigned long pattern = ones * (unsigned char)c;
+	unsigned long word = 0;
+#endif
+
+#if defined(_MEMSCAN_AVX2)
+	for (; i + 32 <= count; i += 32)
+	{
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&array[i]), c32));
+		if (mask != 0)
+			return i + _ctz(mask);
+	}
+#endif
+#if defined(_MEMSCAN_SSE2)
+	for (; i + 16 <= count; i += 16)
+	{
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&array[i]), c16));
+		if (mask != 0)
+			return i + _ctz(mask);
+	}
+#else
+	/* A byte of `word` is 0 where `array` has `c`. The test may flag bytes
+	 * past the first match, but never a word that has none. */
+	for (; i + sizeof word <= count; i += sizeof word)
+	{
+		memcpy(&word, &array[i], sizeof word);
+		word ^= pattern;
+		if (((word - ones) & ~word & (ones << 7)) != 0)
+			break;
+	}
+#endif
+
+	for (; i < count; i++)
+		if (array[i] == c)
+			break;
+	return i;
+}
+
+size_t
+memscan_nul(const char *cstr, size_t max)
+{
+	size_t i = 0;
+#if defined(_MEMSCAN_SSE2) && !defined(__SANITIZE_ADDRESS__)
+	__m128i zero = _mm_setzero_si128();
+	size_t offset = 0;
+	unsigned mask = 0;
+
+	/* Aligned loads never cross a page, so reading past the NUL up to the
+	 * end of its 16 bytes block is safe. The sanitizer doesn't know that,
+	 * it gets the plain loop. */
+	offset = (size_t)cstr & 15;
+	mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+	           _mm_load_si128((const __m128i *)(cstr - offset)), zero)) >>
+	       offset;
+	if (mask != 0)
+		i = _ctz(mask);
+	else
+	{
+		for (i = 16 - offset; i < max; i += 16)
+		{
+			mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			    _mm_load_si128((const __m128i *)&cstr[i]), zero));
+			if (mask != 0)
+			{
+				i += _ctz(mask);
+				break;
+			}
+		}
+	}
+	return i < max ? i : max;
+#else
+	for (i = 0; i < max && cstr[i] != '\0'; i++)
+		;
+	return i;
+#endif
+}
@@ -18,25 +18,38 @@
 #include "rule.h"
 #include "intdef.h"
 #include "scan.h"
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
+static void
+matcher_all(struct matcher *matcher)
+{
+	matcher->type = MATCHER_TYPE_ALL;
+	matcher->count = 0;
+	matcher->index = 0;
+	matcher->from = INT_MIN;
+	matcher->to = INT_MAX;
+}
+
+/* Multi items are appended to the items of `rule`, which must have room for
+ * them. */
 static int
-matcher_compile(const char *input, usize input_count,
+matcher_compile(const char *input, usize input_count, struct rule *rule,
                 struct matcher *ret_matcher)
 {
-	struct matcher *matcher_array = NULL;
-	int multi_index = 0;
+	struct matcher *item = NULL;
 	int multi_count = 1;
+	int item_i = 0;
 	isize range_index = -1;
-	usize matcher_start = 0;
+	usize item_start = 0;
 	usize i = 0;
+	int value = 0;
 	int r = 0;
 
+	matcher_all(ret_matcher);
 	if (input_count == 1 && input[0] == '*')
-	{
-		ret_matcher->type = MATCHER_TYPE_ALL;
 		return RULE_OK;
-	}
 
 	for (i = 0; i < input_count; i++)
 	{
@@ -53,105 +66,103 @@ matcher_compile(const char *input, usize input_count,
 
 	if (multi_count > 1)
 	{
+		if (multi_count > 0xffff)
+			return RULE_EINVALNUM;
+
 		ret_matcher->type = MATCHER_TYPE_MULTI;
-		ret_matcher->data.multi.count = multi_count;
-	}
-	else if (range_index >= 0)
-		ret_matcher->type = MATCHER_TYPE_RANGE;
-	else
-		ret_matcher->type = MATCHER_TYPE_SIMPLE;
+		ret_matcher->count = multi_count;
+		ret_matcher->index = rule->item_count;
+		ret_matcher->from = INT_MAX;
+		ret_matcher->to = INT_MIN;
+		rule->item_count += multi_count;
 
-	switch (ret_matcher->type)
-	{
-		case MATCHER_TYPE_SIMPLE:
-			r = scan_int(input, input_count,
-			             &ret_matcher->data.simple.value);
-			if (r != RULE_OK)
-				goto _done;
-			break;
+		/* Items are never multi, there's no comma left in them. The
+		 * multi's own bounds are the interval its items fit in. */
+		for (i = 0; i <= input_count; i++)
+		{
+			if (i < input_count && input[i] != ',')
+				continue;
 
-		case MATCHER_TYPE_RANGE:
-			r = scan_int(input, range_index,
-			             &ret_matcher->data.range.from);
-			if (r != RULE_OK)
-				goto _done;
-			r = scan_int(&input[range_index + 1],
-			             input_count - range_index - 1,
-			             &ret_matcher->data.range.to);
+			item = rule_item(rule, ret_matcher, item_i++);
+			r = matcher_compile(&input[item_start], i - item_start,
+			                    rule, item);
 			if (r != RULE_OK)
-				goto _done;
-			break;
+				return r;
+			if (item->from < ret_matcher->from)
+				ret_matcher->from = item->from;
+			if (item->to > ret_matcher->to)
+				ret_matcher->to = item->to;
+			item_start = i + 1;
+		}
+		return RULE_OK;
+	}
 
-		case MATCHER_TYPE_MULTI:
-			matcher_array =
-			    malloc(sizeof(struct matcher) * multi_count);
-			if (matcher_array == NULL)
-			{
-				r = RULE_EOOM;
-				goto _done;
-			}
-			for (i = 0; i < input_count; i++)
-			{
-				switch (input[i])
-				{
-					case ',':
-						r = matcher_compile(
-						    &input[matcher_start],
-						    i - matcher_start,
-						    &matcher_array
-						        [multi_index]);
-						if (r != RULE_OK)
-							goto _done;
-						matcher_start = i + 1;
-						multi_index++;
-						break;
-				}
-			}
-			r = matcher_compile(&input[matcher_start],
-			                    i - matcher_start,
-			                    &matcher_array[multi_index]);
-			if (r != RULE_OK)
-				goto _done;
-			ret_matcher->data.multi.array = matcher_array;
-			matcher_array = NULL;
-			break;
+	if (range_index >= 0)
+	{
+		ret_matcher->type = MATCHER_TYPE_RANGE;
+		r = scan_int(input, range_index, &value);
+		if (r != RULE_OK)
+			return r;
+		ret_matcher->from = value;
+		r = scan_int(&input[range_index + 1],
+		             input_count - range_index - 1, &value);
+		if (r != RULE_OK)
+			return r;
+		ret_matcher->to = value;
+		return RULE_OK;
 	}
 
-	r = RULE_OK;
-_done:
-	if (r != RULE_OK && matcher_array != NULL)
-		free(matcher_array);
-	return r;
+	ret_matcher->type = MATCHER_TYPE_SIMPLE;
+	r = scan_int(input, input_count, &value);
+	if (r != RULE_OK)
+		return r;
+	ret_matcher->from = value;
+	ret_matcher->to = value;
+	return RULE_OK;
 }
 
 /* non-0 = match */
 static int
-matcher_matches(struct matcher *matcher, int value)
+matcher_matches(struct rule *rule, struct matcher *matcher, int value)
 {
 	int i = 0;
 
-	switch (matcher->type)
-	{
-		case MATCHER_TYPE_ALL:
-			return 1;
+	if (matcher->type != MATCHER_TYPE_MULTI)
+		return matcher->from <= value && matcher->to >= value;
 
-		case MATCHER_TYPE_SIMPLE:
-			return matcher->data.simple.value == value;
-
-		case MATCHER_TYPE_RANGE:
-			return matcher->data.range.from <= value &&
-			       matcher->data.range.to >= value;
+	for (i = 0; i < matcher->count; i++)
+		if (matcher_matches(rule, rule_item(rule, matcher, i), value))
+			return 1;
+	return 0;
+}
 
-		case MATCHER_TYPE_MULTI:
-			for (i = 0; i < matcher->data.multi.count; i++)
-				if (matcher_matches(
-				        &matcher->data.multi.array[i], value))
-					return 1;
+/* Bit N set when `matcher` matches `sign * N`, for N in 1 to `max`. */
+static u32
+matcher_mask(struct rule *rule, struct matcher *matcher, int sign, int max)
+{
+	u32 mask = 0;
+	int i = 0;
 
-			return 0;
-	}
+	for (i = 1; i <= max; i++)
+		if (matcher_matches(rule, matcher, sign * i))
+			mask |= (u32)1 << i;
+	return mask;
+}
 
-	return 0;
+static void
+rule_lower(struct rule *rule)
+{
+	/* Days of years past these can't be counted, they never match. */
+	rule->year_from = (rule->year.from < DATE_YEAR_MIN) ? DATE_YEAR_MIN
+	                                                    : rule->year.from;
+	rule->year_to = (rule->year.to > DATE_YEAR_MAX) ? DATE_YEAR_MAX
+	                                                : rule->year.to;
+	rule->month_mask =
+	    matcher_mask(rule, &rule->month, 1, MONTH_DECEMBER);
+	rule->week_day_mask =
+	    matcher_mask(rule, &rule->week_day, 1, WEEK_DAY_SATURDAY);
+	rule->day_mask = matcher_mask(rule, &rule->day, 1, 31);
+	rule->negative_day_mask = matcher_mask(rule, &rule->day, -1, 31);
 }
 
 int
@@ -159,21 +170,43 @@ rule_compile(const char *input, usize input_count,
              struct rule **ret_rule)
 {
 	struct matcher *current_matcher = NULL;
+	usize item_capacity = 0;
 	usize matcher_start = 0;
 	usize i = 0;
 	int r = 0;
 
-	*ret_rule = malloc(sizeof(struct rule));
+	/* Every multi item but the first follows a comma, and each field
+	 * starts at its letter. */
+	for (i = 0; i < input_count; i++)
+	{
+		switch (input[i])
+		{
+			case ',':
+			case 'y':
+			case 'm':
+			case 'd':
+			case 'w':
+				item_capacity++;
+				break;
+		}
+	}
+
+	*ret_rule = malloc(sizeof(struct rule) +
+	                   sizeof(struct matcher) * item_capacity);
 	if (*ret_rule == NULL)
 	{
 		r = RULE_EOOM;
 		goto _done;
 	}
 
-	(*ret_rule)->year.type = MATCHER_TYPE_ALL;
-	(*ret_rule)->month.type = MATCHER_TYPE_ALL;
-	(*ret_rule)->day.type = MATCHER_TYPE_ALL;
-	(*ret_rule)->week_day.type = MATCHER_TYPE_ALL;
+	/* Rules are stored byte for byte as blobs, don't let the header's
+	 * padding carry whatever the allocator left there. */
+	memset(*ret_rule, 0, sizeof(struct rule));
+	(*ret_rule)->item_count = 0;
+	matcher_all(&(*ret_rule)->year);
+	matcher_all(&(*ret_rule)->month);
+	matcher_all(&(*ret_rule)->day);
+	matcher_all(&(*ret_rule)->week_day);
 
 	for (i = 0; i < input_count; i++)
 	{
@@ -188,7 +221,8 @@ rule_compile(const char *input, usize input_count,
 				{
 					r = matcher_compile(
 					    &input[matcher_start],
-					    i - matcher_start, current_matcher);
+					    i - matcher_start, *ret_rule,
+					    current_matcher);
 					if (r != RULE_OK)
 						goto _done;
 				}
@@ -230,11 +264,13 @@ rule_compile(const char *input, usize input_count,
 	if (current_matcher != NULL)
 	{
 		r = matcher_compile(&input[matcher_start], i - matcher_start,
-		                    current_matcher);
+		                    *ret_rule, current_matcher);
 		if (r != RULE_OK)
 			goto _done;
 	}
 
+	rule_lower(*ret_rule);
+
 	r = RULE_OK;
 _done:
 	if (r != RULE_OK && *ret_rule != NULL)
@@ -248,30 +284,341 @@ _done:
 void
 rule_free(struct rule *rule)
 {
-	if (rule->year.type == MATCHER_TYPE_MULTI)
-		free(rule->year.data.multi.array);
-	if (rule->month.type == MATCHER_TYPE_MULTI)
-		free(rule->month.data.multi.array);
-	if (rule->day.type == MATCHER_TYPE_MULTI)
-		free(rule->day.data.multi.array);
-	if (rule->week_day.type == MATCHER_TYPE_MULTI)
-		free(rule->week_day.data.multi.array);
 	free(rule);
 }
 
-/* non-0 = match */
+usize
+rule_size(struct rule *rule)
+{
+	return sizeof(struct rule) + sizeof(struct matcher) * rule->item_count;
+}
+
+/* non-0 = valid */
+static int
+_blob_matcher_valid(struct rule *rule, struct matcher *matcher)
+{
+	int i = 0;
+
+	switch (matcher->type)
+	{
+		case MATCHER_TYPE_ALL:
+		case MATCHER_TYPE_SIMPLE:
+		case MATCHER_TYPE_RANGE:
+			return 1;
+
+		case MATCHER_TYPE_MULTI:
+			if (matcher->index > rule->item_count ||
+			    matcher->count > rule->item_count - matcher->index)
+				return 0;
+			for (i = 0; i < matcher->count; i++)
+				if (rule_item(rule, matcher, i)->type ==
+				        MATCHER_TYPE_MULTI ||
+				    !_blob_matcher_valid(
+				        rule, rule_item(rule, matcher, i)))
+					return 0;
+			return 1;
+	}
+
+	return 0;
+}
+
 int
-rule_matches(struct rule *rule, struct weekdate *date)
+rule_load_alloc(const void *blob, usize blob_count, struct rule **ret_rule)
 {
-	if (!matcher_matches(&rule->year, date->year))
+	struct rule *rule = NULL;
+	int r = 0;
+
+	if (blob_count < sizeof(struct rule))
+	{
+		r = RULE_EINVALBLOB;
+		goto _done;
+	}
+
+	rule = malloc(blob_count);
+	if (rule == NULL)
+	{
+		r = RULE_EOOM;
+		goto _done;
+	}
+	memcpy(rule, blob, blob_count);
+
+	if (rule->item_count > (blob_count - sizeof(struct rule)) /
+	                           sizeof(struct matcher) ||
+	    rule_size(rule) != blob_count ||
+	    !_blob_matcher_valid(rule, &rule->year) ||
+	    !_blob_matcher_valid(rule, &rule->month) ||
+	    !_blob_matcher_valid(rule, &rule->day) ||
+	    !_blob_matcher_valid(rule, &rule->week_day))
+	{
+		r = RULE_EINVALBLOB;
+		goto _done;
+	}
+
+	*ret_rule = rule;
+	rule = NULL;
+
+	r = RULE_OK;
+_done:
+	if (rule != NULL)
+		free(rule);
+	return r;
+}
+
+struct matcher *
+rule_item(struct rule *rule, struct matcher *matcher, int i)
+{
+	return &((struct matcher *)(rule + 1))[matcher->index + i];
+}
+
+/* non-0 = match */
+static int
+_year_matches(struct rule *rule, int year)
+{
+	if (year < rule->year_from || year > rule->year_to)
 		return 0;
-	if (!matcher_matches(&rule->month, date->month))
+	if (rule->year.type == MATCHER_TYPE_MULTI &&
+	    !matcher_matches(rule, &rule->year, year))
 		return 0;
-	if (!matcher_matches(&rule->day, date->day) &&
-	    !matcher_matches(&rule->day,
-	                     date_negative_day((struct date *)date)))
+	return 1;
+}
+
+/* non-0 = match. Expects a valid date. */
+static int
+_matches(struct rule *rule, int year, int month, int day, int negative_day,
+         int week_day)
+{
+	if (!_year_matches(rule, year))
 		return 0;
-	if (!matcher_matches(&rule->week_day, date->week_day))
+	return (rule->month_mask >> month) &
+	       ((rule->day_mask >> day) |
+	        (rule->negative_day_mask >> -negative_day)) &
+	       (rule->week_day_mask >> week_day) & 1;
+}
+
+int
+rule_matches(struct rule *rule, struct weekdate *date)
+{
+	if (date->month < MONTH_JANUARY || date->month > MONTH_DECEMBER ||
+	    date->day < 1 ||
+	    date->day > date_month_last_day(date->year, date->month) ||
+	    date->week_day < WEEK_DAY_SUNDAY ||
+	    date->week_day > WEEK_DAY_SATURDAY)
 		return 0;
-	return 1;
+	return _matches(rule, date->year, date->month, date->day,
+	                date_negative_day((struct date *)date),
+	                date->week_day);
+}
+
+int
+rule_matches_calendar(struct rule *rule, struct calendar *cal)
+{
+	return _matches(rule, cal->table->year, cal->at->month, cal->at->day,
+	                cal->at->negative_day, cal->at->week_day);
+}
+
+static u32
+_reverse(u32 bits)
+{
+	bits = ((bits >> 1) & 0x55555555u) | ((bits & 0x55555555u) << 1);
+	bits = ((bits >> 2) & 0x33333333u) | ((bits & 0x33333333u) << 2);
+	bits = ((bits >> 4) & 0x0f0f0f0fu) | ((bits & 0x0f0f0f0fu) << 4);
+	bits = ((bits >> 8) & 0x00ff00ffu) | ((bits & 0x00ff00ffu) << 8);
+	return (bits >> 16) | (bits << 16);
+}
+
+/* Bit N set when day N + 1 of a month matches the day and week day masks.
+ * `negative_reversed` has bit 31 - N for day -N. */
+static u32
+_month_bits(struct rule *rule, u32 negative_reversed, int last_day,
+            int first_week_day)
+{
+	u32 days = 0;
+	u32 week = 0;
+	int shift = 0;
+
+	days = (rule->day_mask >> 1) | (negative_reversed >> (31 - last_day));
+
+	/* Rotate the week day mask to start at the month's first day, then
+	 * repeat it over the month. */
+	shift = first_week_day - WEEK_DAY_SUNDAY;
+	week = (rule->week_day_mask >> 1) & 0x7fu;
+	week = ((week >> shift) | (week << (7 - shift))) & 0x7fu;
+	week |= (week << 7) | (week << 14) | (week << 21) | (week << 28);
+
+	return days & week & (((u32)1 << last_day) - 1);
+}
+
+static void
+_bitmap_or(u64 *bitmap, usize offset, u32 bits)
+{
+	usize word = 0;
+	int shift = 0;
+
+	word = offset / 64;
+	shift = offset % 64;
+	bitmap[word] |= (u64)bits << shift;
+	if (shift > 32 && (bits >> (64 - shift)) != 0)
+		bitmap[word + 1] |= (u64)bits >> (64 - shift);
+}
+
+void
+rule_match_range(struct rule *rule, daynum from, daynum to,
+                 u64 *ret_bitmap)
+{
+	struct date date = DATE_ZERO;
+	daynum month_first = 0;
+	daynum first = 0;
+	u32 negative_reversed = 0;
+	u32 bits = 0;
+	int last_day = 0;
+	int week_day = 0;
+	usize i = 0;
+
+	if (to < from)
+		return;
+
+	for (i = 0; i < RULE_RANGE_WORD_COUNT(from, to); i++)
+		ret_bitmap[i] = 0;
+
+	negative_reversed = _reverse(rule->negative_day_mask);
+
+	daynum_to_date(from, &date);
+	month_first = from - (date.day - 1);
+	week_day = daynum_week_day(month_first);
+	while (month_first <= to)
+	{
+		last_day = date_month_last_day(date.year, date.month);
+		if (((rule->month_mask >> date.month) & 1) &&
+		    _year_matches(rule, date.year))
+		{
+			/* Only the part of the month within the range. */
+			first = (month_first < from) ? from : month_first;
+			bits = _month_bits(rule, negative_reversed, last_day,
+			                   week_day) >>
+			       (first - month_first);
+			if (to - first < 31)
+				bits &= ((u32)1 << (to - first + 1)) - 1;
+			if (bits != 0)
+				_bitmap_or(ret_bitmap, first - from, bits);
+		}
+
+		month_first += last_day;
+		week_day = (week_day - WEEK_DAY_SUNDAY + last_day) % 7 +
+		           WEEK_DAY_SUNDAY;
+		date.month += 1;
+		if (date.month > MONTH_DECEMBER)
+		{
+			date.month = MONTH_JANUARY;
+			date.year += 1;
+		}
+	}
+}
+
+/* Index of the lowest set bit, `bits` can't be 0. */
+static int
+_lowest_bit(u32 bits)
+{
+	static const int debruijn[32] = { 0,  1,  28, 2,  29, 14, 24, 3,
+		                          30, 22, 20, 15, 25, 17, 4,  8,
+		                          31, 27, 13, 23, 21, 19, 16, 7,
+		                          26, 12, 18, 6,  11, 5,  10, 9 };
+
+	return debruijn[((bits & (~bits + 1)) * 0x077cb531u) >> 27];
+}
+
+/* non-0 = found. First year at or after `year` the year matcher allows. */
+static int
+_year_next(struct rule *rule, int year, int *ret_year)
+{
+	struct matcher *item = NULL;
+	int candidate = 0;
+	int found = 0;
+	int i = 0;
+
+	if (year < rule->year_from)
+		year = rule->year_from;
+	if (year > rule->year_to)
+		return 0;
+	if (rule->year.type != MATCHER_TYPE_MULTI)
+	{
+		*ret_year = year;
+		return 1;
+	}
+
+	for (i = 0; i < rule->year.count; i++)
+	{
+		item = rule_item(rule, &rule->year, i);
+		if (item->to < year)
+			continue;
+
+		candidate = (item->from > year) ? item->from : year;
+		if (candidate > rule->year_to)
+			continue;
+		if (!found || candidate < *ret_year)
+			*ret_year = candidate;
+		found = 1;
+	}
+
+	return found;
+}
+
+int
+rule_next_match(struct rule *rule, daynum from, daynum *ret_day)
+{
+	struct date date = DATE_ZERO;
+	struct date month_first = DATE_ZERO;
+	daynum month_first_day = 0;
+	u32 negative_reversed = 0;
+	u32 bits = 0;
+	int run_count = 0;
+	int year = 0;
+	int next_year = 0;
+	int last_day = 0;
+
+	negative_reversed = _reverse(rule->negative_day_mask);
+
+	daynum_to_date(from, &date);
+	if (!_year_next(rule, date.year, &year))
+		return RULE_OK_NONE;
+
+	for (;;)
+	{
+		if (year != date.year)
+		{
+			date.year = year;
+			date.month = MONTH_JANUARY;
+			date.day = 1;
+		}
+
+		for (; date.month <= MONTH_DECEMBER; date.month++, date.day = 1)
+		{
+			if (((rule->month_mask >> date.month) & 1) == 0)
+				continue;
+
+			month_first.year = date.year;
+			month_first.month = date.month;
+			month_first.day = 1;
+			month_first_day = daynum_from_date(&month_first);
+			last_day = date_month_last_day(date.year, date.month);
+			bits = _month_bits(rule, negative_reversed, last_day,
+			                   daynum_week_day(month_first_day));
+			bits &= ~(((u32)1 << (date.day - 1)) - 1);
+			if (bits != 0)
+			{
+				*ret_day = month_first_day + _lowest_bit(bits);
+				return RULE_OK;
+			}
+		}
+
+		/* Whether a year has a match only depends on where it falls
+		 * in the 400 year cycle, so 400 years in a row without one
+		 * means no year has. Jumping over years starts a new run. */
+		run_count += 1;
+		if (run_count >= 400 || year >= rule->year_to ||
+		    !_year_next(rule, year + 1, &next_year))
+			return RULE_OK_NONE;
+		if (next_year != year + 1)
+			run_count = 0;
+		year = next_year;
+	}
 }
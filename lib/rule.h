@@ -24,10 +24,16 @@
 enum
 {
 	RULE_OK = 0,
+	RULE_OK_NONE, /* No day matches */
 	RULE_EINVALNUM,
-	RULE_EOOM
+	RULE_EOOM,
+	RULE_EINVALBLOB
 };
 
+/* Version of the layout `rule_load_alloc` expects, bumped whenever struct
+ * rule or struct matcher change. */
+#define RULE_BLOB_VERSION 1
+
 enum
 {
 	MATCHER_TYPE_ALL = 0,
@@ -36,36 +42,35 @@ enum
 	MATCHER_TYPE_MULTI
 };
 
-struct matcher_simple
-{
-	int value;
-};
-
-struct matcher_range
-{
-	int from;
-	int to;
-};
-
-struct matcher_multi
-{
-	int count;
-	struct matcher *array;
-};
-
+/* SIMPLE has `from` == `to`, the value. MULTI has `count` items, each a
+ * matcher of any other type, from `index` in the rule's item array. */
 struct matcher
 {
-	int type;
-	union
-	{
-		struct matcher_simple simple;
-		struct matcher_range range;
-		struct matcher_multi multi;
-	} data;
+	u16 type;
+	u16 count;
+	u32 index;
+	i32 from;
+	i32 to;
 };
 
+/* A rule is one block with no pointers: this header followed by
+ * `item_count` matchers, the items of its multi matchers. It can be freed
+ * with free(3) and copied or stored as `rule_size` bytes. */
 struct rule
 {
+	u32 item_count;
+
+	/* The matchers lowered by `rule_compile`, bit N is set when N
+	 * matches. Multi year matchers are lowered to the interval they fit
+	 * in and checked on top of it. Matching only reads these. */
+	i32 year_from;
+	i32 year_to;
+	u16 month_mask;
+	u8 week_day_mask;
+	u32 day_mask;
+	/* Bit N for day -N. */
+	u32 negative_day_mask;
+
 	struct matcher year;
 	struct matcher month;
 	struct matcher day;
@@ -76,6 +81,36 @@ int rule_compile(const char *input, usize input_count, struct rule **ret_rule);
 
 void rule_free(struct rule *rule);
 
+usize rule_size(struct rule *rule);
+
+/* OK | EINVALBLOB | EOOM. Copies a rule stored as its `rule_size` bytes,
+ * checking it's consistent first. Blobs are in host byte order and only
+ * valid for RULE_BLOB_VERSION. */
+int rule_load_alloc(const void *blob, usize blob_count,
+                    struct rule **ret_rule);
+
+/* Item `i` of the multi matcher `matcher` of `rule`. */
+struct matcher *rule_item(struct rule *rule, struct matcher *matcher, int i);
+
 int rule_matches(struct rule *rule, struct weekdate *date);
 
+int rule_matches_calendar(struct rule *rule, struct calendar *cal);
+
+/* Words needed by `rule_match_range` for the days `from` to `to`, 0 when
+ * `to` is before `from`. */
+#define RULE_RANGE_WORD_COUNT(from, to)                                        \
+	((to) < (from) ? 0 : (usize)((to) - (from)) / 64 + 1)
+
+/* Sets bit N of `ret_bitmap` when day `from + N` matches, for every day from
+ * `from` to `to` inclusive. Works a month at a time instead of a day at a
+ * time. `ret_bitmap` must have RULE_RANGE_WORD_COUNT(from, to) words. Does
+ * nothing when `to` is before `from`. */
+void rule_match_range(struct rule *rule, daynum from, daynum to,
+                      u64 *ret_bitmap);
+
+/* OK | OK_NONE. First day at or after `from` that matches, jumping over
+ * years and months that can't. The calendar repeats every 400 years, so it
+ * gives up after 400 allowed years in a row without a match. */
+int rule_next_match(struct rule *rule, daynum from, daynum *ret_day);
+
 #endif /* !RULE_H */
@@ -0,0 +1,148 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "rule_index.h"
+#include <stdlib.h>
+
+#define _MONTH_BUCKET_COUNT    (MONTH_DECEMBER + 1)
+#define _DAY_BUCKET_COUNT      32
+#define _WEEK_DAY_BUCKET_COUNT (WEEK_DAY_SATURDAY + 1)
+
+/* Sets bit `i` of every bucket whose value is in `mask`. */
+static void
+_bucket_put(u64 *bucket_array, usize word_count, int bucket_count, u32 mask,
+            usize i)
+{
+	int value = 0;
+
+	for (value = 0; value < bucket_count; value++)
+		if ((mask >> value) & 1)
+			bucket_array[value * word_count + i / 64] |=
+			    (u64)1 << (i % 64);
+}
+
+int
+rule_index_alloc(struct rule **rule_array, usize rule_count,
+                 struct rule_index **ret_index)
+{
+	struct rule_index *index = NULL;
+	struct rule *rule = NULL;
+	usize bucket_count = 0;
+	usize i = 0;
+	int r = 0;
+
+	index = malloc(sizeof(struct rule_index));
+	if (index == NULL)
+	{
+		r = RULE_INDEX_EOOM;
+		goto _done;
+	}
+
+	index->rule_count = rule_count;
+	index->word_count = (rule_count + 63) / 64;
+	index->rule_array = rule_array;
+
+	bucket_count = _MONTH_BUCKET_COUNT + 2 * _DAY_BUCKET_COUNT +
+	               _WEEK_DAY_BUCKET_COUNT;
+	/* An empty index still gets a word per bucket, calloc may give NULL
+	 * for 0 bytes. */
+	index->month_array = calloc(
+	    bucket_count * (index->word_count > 0 ? index->word_count : 1),
+	    sizeof(u64));
+	if (index->month_array == NULL)
+	{
+		r = RULE_INDEX_EOOM;
+		goto _done;
+	}
+	index->day_array =
+	    &index->month_array[_MONTH_BUCKET_COUNT * index->word_count];
+	index->negative_day_array =
+	    &index->day_array[_DAY_BUCKET_COUNT * index->word_count];
+	index->week_day_array =
+	    &index->negative_day_array[_DAY_BUCKET_COUNT * index->word_count];
+
+	for (i = 0; i < rule_count; i++)
+	{
+		rule = rule_array[i];
+		_bucket_put(index->month_array, index->word_count,
+		            _MONTH_BUCKET_COUNT, rule->month_mask, i);
+		_bucket_put(index->day_array, index->word_count,
+		            _DAY_BUCKET_COUNT, rule->day_mask, i);
+		_bucket_put(index->negative_day_array, index->word_count,
+		            _DAY_BUCKET_COUNT, rule->negative_day_mask, i);
+		_bucket_put(index->week_day_array, index->word_count,
+		            _WEEK_DAY_BUCKET_COUNT, rule->week_day_mask, i);
+	}
+
+	*ret_index = index;
+	index = NULL;
+
+	r = RULE_INDEX_OK;
+_done:
+	if (index != NULL)
+		free(index);
+	return r;
+}
+
+usize
+rule_index_match(struct rule_index *index, struct calendar *cal,
+                 u64 *ret_bitmap)
+{
+	const u64 *month = NULL;
+	const u64 *day = NULL;
+	const u64 *negative_day = NULL;
+	const u64 *week_day = NULL;
+	usize match_count = 0;
+	usize i = 0;
+	u64 word = 0;
+	int bit = 0;
+
+	month = &index->month_array[cal->at->month * index->word_count];
+	day = &index->day_array[cal->at->day * index->word_count];
+	negative_day = &index->negative_day_array[-cal->at->negative_day *
+	                                          index->word_count];
+	week_day =
+	    &index->week_day_array[cal->at->week_day * index->word_count];
+
+	for (i = 0; i < index->word_count; i++)
+	{
+		word = month[i] & (day[i] | negative_day[i]) & week_day[i];
+
+		/* Years aren't bucketed, the few candidates left are checked
+		 * in full. */
+		for (bit = 0; bit < 64 && (word >> bit) != 0; bit++)
+		{
+			if (((word >> bit) & 1) == 0)
+				continue;
+			if (rule_matches_calendar(
+			        index->rule_array[i * 64 + bit], cal))
+				match_count += 1;
+			else
+				word &= ~((u64)1 << bit);
+		}
+		ret_bitmap[i] = word;
+	}
+
+	return match_count;
+}
+
+void
+rule_index_free(struct rule_index *index)
+{
+	free(index->month_array);
+	free(index);
+}
@@ -0,0 +1,59 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RULE_INDEX_H
+#define RULE_INDEX_H
+
+#include "date.h"
+#include "intdef.h"
+#include "rule.h"
+
+/* Compiled rules bucketed by the values they accept. A day's candidates are
+ * the intersection of the buckets of its month, day or negative day, and week
+ * day, a word of 64 rules at a time. */
+struct rule_index
+{
+	usize rule_count;
+	/* Words per bucket. */
+	usize word_count;
+	/* Not owned. */
+	struct rule **rule_array;
+	/* Bit N of bucket V is set when rule N accepts V. */
+	u64 *month_array;
+	u64 *day_array;
+	/* Bucket N for day -N. */
+	u64 *negative_day_array;
+	u64 *week_day_array;
+};
+
+enum
+{
+	RULE_INDEX_OK = 0,
+	RULE_INDEX_EOOM
+};
+
+int rule_index_alloc(struct rule **rule_array, usize rule_count,
+                     struct rule_index **ret_index);
+
+/* Sets bit N of `ret_bitmap` when `rule_array[N]` matches the day at `cal`,
+ * returns how many do. `ret_bitmap` must have `index->word_count` words. */
+usize rule_index_match(struct rule_index *index, struct calendar *cal,
+                       u64 *ret_bitmap);
+
+void rule_index_free(struct rule_index *index);
+
+#endif /* !RULE_INDEX_H */
@@ -16,12 +16,15 @@
  */
 
 #include "rule_lua.h"
+#include "agenda_dedup.h"
 #include "date.h"
+#include "intern.h"
 #include "lua.h"
 #include "str.h"
 #include <lauxlib.h>
 #include <lualib.h>
 #include <stdlib.h>
+#include <string.h>
 
 int
 rule_lua_alloc(struct rule **ret_rule)
@@ -62,10 +65,44 @@ _done:
 	return r;
 }
 
+/* Names the rule at the top of the stack, the name is the first tag of every
+ * entry it generates. Rules must be tables, names can't break the tag_csv. */
+static int
+_name_set(struct rule *rule, const char *name, size_t count,
+          const char **reterr_lua_error)
+{
+	size_t i = 0;
+
+	if (!lua_istable(rule->lua_state, -1))
+	{
+		if (reterr_lua_error != NULL)
+			*reterr_lua_error = "rule must return a table";
+		return RULE_ELUA;
+	}
+
+	for (i = 0; i < count; i++)
+		if (name[i] == ',' || name[i] == '\t' || name[i] == '\n')
+			break;
+	if (count == 0 || i < count)
+	{
+		if (reterr_lua_error != NULL)
+			*reterr_lua_error = "rule name must be a non empty "
+			                    "tag, without ',', tab or newline";
+		return RULE_ELUA;
+	}
+
+	lua_pushlstring(rule->lua_state, name, count);
+	lua_setfield(rule->lua_state, -2, "name");
+	return RULE_OK;
+}
+
 int
 rule_add_file(struct rule *rule, const char *lua_source_path,
               const char **reterr_lua_error)
 {
+	const char *name = NULL;
+	size_t count = 0;
+	size_t i = 0;
 	int r = 0;
 
 	/* Load the Lua source. */
@@ -77,6 +114,22 @@ rule_add_file(struct rule *rule, const char *lua_source_path,
 		goto _done;
 	}
 
+	/* Named after the file, without directory and extension. */
+	name = lua_source_path;
+	for (i = 0; lua_source_path[i] != '\0'; i++)
+		if (lua_source_path[i] == '/' || lua_source_path[i] == '\\')
+			name = &lua_source_path[i + 1];
+	count = cstr_len(name);
+	if (count > 4 && strcmp(&name[count - 4], ".lua") == 0)
+		count -= 4;
+
+	r = _name_set(rule, name, count, reterr_lua_error);
+	if (r != RULE_OK)
+	{
+		lua_pop(rule->lua_state, 1);
+		goto _done;
+	}
+
 	/* Assign the return value to the global rules array at index. */
 	lua_seti(rule->lua_state, -2, rule->rule_count);
 
@@ -88,7 +141,7 @@ _done:
 }
 
 int
-rule_add_string(struct rule *rule, const char *lua_source,
+rule_add_string(struct rule *rule, const char *name, const char *lua_source,
                 const char **reterr_lua_error)
 {
 	int r = 0;
@@ -102,6 +155,13 @@ rule_add_string(struct rule *rule, const char *lua_source,
 		goto _done;
 	}
 
+	r = _name_set(rule, name, cstr_len(name), reterr_lua_error);
+	if (r != RULE_OK)
+	{
+		lua_pop(rule->lua_state, 1);
+		goto _done;
+	}
+
 	/* Assign the return value to the global rules array at index. */
 	lua_seti(rule->lua_state, -2, rule->rule_count);
 
@@ -112,14 +172,40 @@ _done:
 	return r;
 }
 
+/* Checks whether the rule at the top of the stack already has an entry at
+ * `day`, by its name. */
+static int
+_dedup_has(struct rule *rule, struct agenda_dedup *dedup, daynum day,
+           int *ret_has)
+{
+	struct str name = { 0, NULL };
+	int r = 0;
+
+	lua_getfield(rule->lua_state, -1, "name");
+	/* s: G, date, G[i], G[i].name. */
+
+	name.array = (char *)lua_tostring(rule->lua_state, -1);
+	name.count = cstr_len(name.array);
+	r = agenda_dedup_has(dedup, day, &name, ret_has) == AGENDA_DEDUP_OK
+	        ? RULE_OK
+	        : RULE_EOOM;
+
+	lua_pop(rule->lua_state, 1);
+	/* s: G, date, G[i]. */
+	return r;
+}
+
 int
-rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
-         size_t *reterr_index, const char **reterr_lua_error)
+rule_run(struct rule *rule, struct calendar *cal,
+         struct agenda_array *push_to, size_t *reterr_index,
+         const char **reterr_lua_error)
 {
 	struct str *str_title = NULL;
 	struct str *str_tag_csv = NULL;
 	const char *title = NULL;
 	const char *tag_csv = NULL;
+	const char *name = NULL;
+	size_t name_count = 0;
 	size_t i = 0;
 	int trigger_result = 0;
 	int r = 0;
@@ -127,20 +213,25 @@ rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
 
 	lua_top = lua_gettop(rule->lua_state);
 
-	lua_createtable(rule->lua_state, 0, 4);
+	lua_createtable(rule->lua_state, 0, 8);
 	/* s: G, date. */
 
-	lua_pushnumber(rule->lua_state, date->year);
+	lua_pushnumber(rule->lua_state, cal->table->year);
 	lua_setfield(rule->lua_state, -2, "year");
-	lua_pushnumber(rule->lua_state, date->month);
+	lua_pushnumber(rule->lua_state, cal->at->month);
 	lua_setfield(rule->lua_state, -2, "month");
-	lua_pushnumber(rule->lua_state, date->day);
+	lua_pushnumber(rule->lua_state, cal->at->day);
 	lua_setfield(rule->lua_state, -2, "day");
-	lua_pushnumber(rule->lua_state, date->week_day);
+	lua_pushnumber(rule->lua_state, cal->at->week_day);
 	lua_setfield(rule->lua_state, -2, "week_day");
-	lua_pushnumber(rule->lua_state,
-	               date_month_last_day(date->year, date->month));
+	lua_pushnumber(rule->lua_state, cal->at->month_last_day);
 	lua_setfield(rule->lua_state, -2, "last_day_of_month");
+	lua_pushnumber(rule->lua_state, cal->at->day_of_year);
+	lua_setfield(rule->lua_state, -2, "day_of_year");
+	lua_pushnumber(rule->lua_state, cal->at->iso_week);
+	lua_setfield(rule->lua_state, -2, "iso_week");
+	lua_pushnumber(rule->lua_state, cal->at->nth_week_day);
+	lua_setfield(rule->lua_state, -2, "nth_week_day");
 
 	for (i = 0; i < rule->rule_count; i++)
 	{
@@ -200,6 +291,21 @@ rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
 			continue;
 		}
 
+		if (push_to->dedup != NULL)
+		{
+			r = _dedup_has(rule, push_to->dedup, cal->day,
+			               &trigger_result);
+			if (r != RULE_OK)
+				goto _done;
+			if (trigger_result)
+			{
+				lua_remove(rule->lua_state, -1);
+				/* s: G, date. */
+
+				continue;
+			}
+		}
+
 		lua_getfield(rule->lua_state, -1, "title");
 		/* s: G, date, G[i], G[i].title. */
 
@@ -234,15 +340,17 @@ rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
 
 			title = lua_tostring(rule->lua_state, -1);
 
-			lua_remove(rule->lua_state, -1);
-			/* s: G, date, G[i]. */
+			/* Kept on the stack until copied, so it's not
+			 * collected. */
+			lua_insert(rule->lua_state, -2);
+			/* s: G, date, title, G[i]. */
 		}
 		else if (lua_isstring(rule->lua_state, -1))
 		{
 			title = lua_tostring(rule->lua_state, -1);
 
-			lua_remove(rule->lua_state, -1);
-			/* s: G, date, G[i]. */
+			lua_insert(rule->lua_state, -2);
+			/* s: G, date, title, G[i]. */
 		}
 		else
 		{
@@ -256,7 +364,7 @@ rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
 		}
 
 		lua_getfield(rule->lua_state, -1, "tag_csv");
-		/* s: G, date, G[i], G[i].tag_csv. */
+		/* s: G, date, title, G[i], G[i].tag_csv. */
 
 		if (!lua_isstring(rule->lua_state, -1))
 		{
@@ -271,36 +379,70 @@ rule_run(struct rule *rule, struct weekdate *date, struct agenda_array *push_to,
 
 		tag_csv = lua_tostring(rule->lua_state, -1);
 
-		lua_pop(rule->lua_state, 2);
-		/* s: G, date. */
+		lua_getfield(rule->lua_state, -2, "name");
+		/* s: G, date, title, G[i], G[i].tag_csv, G[i].name. */
+
+		/* The rule's name goes first, unless it's there already. */
+		name = lua_tostring(rule->lua_state, -1);
+		name_count = cstr_len(name);
+		if (tag_csv[0] == '\0')
+			tag_csv = name;
+		else if (strncmp(tag_csv, name, name_count) != 0 ||
+		         (tag_csv[name_count] != ',' &&
+		          tag_csv[name_count] != '\0'))
+			tag_csv = lua_pushfstring(rule->lua_state, "%s,%s",
+			                          name, tag_csv);
+		/* s: G, date, title, G[i], G[i].tag_csv, G[i].name,
+		 * tag_csv?. */
 
 		str_title = NULL;
 		str_tag_csv = NULL;
 
-		r = str_alloc(title, &str_title);
-		if (r != STR_OK)
+		if (push_to->intern != NULL)
 		{
-			r = RULE_EOOM;
-			goto _done;
+			/* Shared strings, pushing them moves nothing. */
+			r = intern_put_str(push_to->intern, title,
+			                   cstr_len(title), &str_title);
+			if (r == INTERN_OK)
+				r = intern_put_str(push_to->intern, tag_csv,
+				                   cstr_len(tag_csv),
+				                   &str_tag_csv);
+			if (r != INTERN_OK)
+			{
+				r = RULE_EOOM;
+				goto _done;
+			}
 		}
-
-		r = str_alloc(tag_csv, &str_tag_csv);
-		if (r != STR_OK)
+		else
 		{
-			r = RULE_EOOM;
-			goto _done;
+			r = str_alloc(title, &str_title);
+			if (r != STR_OK)
+			{
+				r = RULE_EOOM;
+				goto _done;
+			}
+
+			r = str_alloc(tag_csv, &str_tag_csv);
+			if (r != STR_OK)
+			{
+				r = RULE_EOOM;
+				goto _done;
+			}
 		}
 
 		/* str_title and str_tag_csv are moved */
-		agenda_array_push_alloc(push_to, (struct date *)date,
+		agenda_array_push_alloc(push_to, cal->day,
 		                        &str_title, &str_tag_csv);
+
+		lua_settop(rule->lua_state, lua_top + 1);
+		/* s: G, date. */
 	}
 
 	r = RULE_OK;
 _done:
-	if (str_title != NULL)
+	if (str_title != NULL && push_to->intern == NULL)
 		free(str_title);
-	if (str_tag_csv != NULL)
+	if (str_tag_csv != NULL && push_to->intern == NULL)
 		free(str_tag_csv);
 	lua_settop(rule->lua_state, lua_top);
 	return r;
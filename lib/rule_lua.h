@@ -37,13 +37,20 @@ struct rule
 
 int rule_lua_alloc(struct rule **ret_rule);
 
+/* The rule is named after the file, e.g. "rules.d/invoice.lua" is
+ * "invoice". */
 int rule_add_file(struct rule *rule, const char *lua_source_path,
                   const char **reterr_lua_error);
 
-int rule_add_string(struct rule *rule, const char *lua_source,
+int rule_add_string(struct rule *rule, const char *name, const char *lua_source,
                     const char **reterr_lua_error);
 
-int rule_run(struct rule *rule, struct weekdate *date,
+/* Pushes an entry for every rule that triggers at `cal->day`. The rule's name
+ * is the first tag of its entries, prepended to 'tag_csv' unless it's there
+ * already. When `push_to->dedup` is set, rules that already have an entry at
+ * that day are skipped before their title is evaluated, so running over the
+ * same days twice adds nothing. */
+int rule_run(struct rule *rule, struct calendar *cal,
              struct agenda_array *push_to, size_t *reterr_index,
              const char **reterr_lua_error);
 
@@ -0,0 +1,206 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "status_file.h"
+#include "fs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* On disk layout. Native endianness, it's a cache of the machine it was
+ * written on. */
+struct _file
+{
+	char magic[8];
+	u32 version;
+	u32 reserved;
+	struct status_file status;
+};
+
+static const char _magic[8] = { 'y', 's', 'a', 'r', 'y', 's', 's', 't' };
+
+static const char _db_magic[16] = "SQLite format 3";
+
+/* "<db>.status". */
+static char *
+_path_alloc(const char *db_path)
+{
+	char *path = NULL;
+	size_t count = 0;
+
+	count = strlen(db_path);
+	path = malloc(count + sizeof(".status"));
+	if (path == NULL)
+		return NULL;
+	memcpy(path, db_path, count);
+	memcpy(&path[count], ".status", sizeof(".status"));
+	return path;
+}
+
+/* non-0 = read. The file change counter from the header of the SQLite
+ * database at `db_path`, a big endian u32 at offset 24. Only counts commits
+ * in rollback journal mode, byte 18 is 1. */
+static int
+_db_change_counter(const char *db_path, u32 *ret_counter)
+{
+	unsigned char header[28];
+	size_t count = 0;
+
+	if (fs_read(db_path, header, sizeof header, &count, NULL) != FS_OK ||
+	    count != sizeof header ||
+	    memcmp(header, _db_magic, sizeof _db_magic) != 0 || header[18] != 1)
+		return 0;
+
+	*ret_counter = ((u32)header[24] << 24) | ((u32)header[25] << 16) |
+	               ((u32)header[26] << 8) | (u32)header[27];
+	return 1;
+}
+
+int
+status_file_read(const char *db_path, i64 now, i64 until,
+                 struct status_file *ret_status)
+{
+	struct _file file;
+	char *path = NULL;
+	size_t count = 0;
+	u32 db_change_counter = 0;
+	int r = 0;
+
+	if (!_db_change_counter(db_path, &db_change_counter))
+	{
+		r = STATUS_FILE_ESTALE;
+		goto _done;
+	}
+
+	path = _path_alloc(db_path);
+	if (path == NULL)
+	{
+		r = STATUS_FILE_ESTALE;
+		goto _done;
+	}
+
+	if (fs_read(path, &file, sizeof file, &count, NULL) != FS_OK ||
+	    count != sizeof file ||
+	    memcmp(file.magic, _magic, sizeof _magic) != 0 ||
+	    file.version != STATUS_FILE_VERSION ||
+	    file.status.db_change_counter != db_change_counter ||
+	    file.status.written_at > now || file.status.until < until ||
+	    file.status.due_count > STATUS_FILE_DUE_MAX)
+	{
+		r = STATUS_FILE_ESTALE;
+		goto _done;
+	}
+
+	*ret_status = file.status;
+
+	r = STATUS_FILE_OK;
+_done:
+	if (path != NULL)
+		free(path);
+	return r;
+}
+
+u64
+status_file_count(const struct status_file *status, i64 at)
+{
+	u64 low = 0;
+	u64 high = 0;
+	u64 mid = 0;
+
+	/* First entry due after `at`. */
+	low = 0;
+	high = status->due_count;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (status->due_array[mid] <= at)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return status->overdue_count + low;
+}
+
+int
+status_file_stamp(const char *db_path, struct status_file *status)
+{
+	if (!_db_change_counter(db_path, &status->db_change_counter))
+		return STATUS_FILE_E;
+	status->reserved = 0;
+	return STATUS_FILE_OK;
+}
+
+int
+status_file_write(const char *db_path, struct status_file *status)
+{
+	struct _file file;
+	char *path = NULL;
+	char *tmp_path = NULL;
+	FILE *fd = NULL;
+	u32 db_change_counter = 0;
+	int ok = 0;
+	int r = 0;
+
+	if (!_db_change_counter(db_path, &db_change_counter))
+	{
+		r = STATUS_FILE_E;
+		goto _done;
+	}
+	if (db_change_counter != status->db_change_counter)
+	{
+		r = STATUS_FILE_ESTALE;
+		goto _done;
+	}
+
+	path = _path_alloc(db_path);
+	if (path == NULL)
+	{
+		r = STATUS_FILE_E;
+		goto _done;
+	}
+
+	memset(&file, 0, sizeof file);
+	memcpy(file.magic, _magic, sizeof _magic);
+	file.version = STATUS_FILE_VERSION;
+	file.status = *status;
+
+	/* A name of its own, concurrent writers can't interleave. */
+	if (fs_temp_open(path, &fd, &tmp_path, NULL) != FS_OK)
+	{
+		r = STATUS_FILE_E;
+		goto _done;
+	}
+
+	ok = fwrite(&file, sizeof file, 1, fd) == 1;
+	ok = fclose(fd) == 0 && ok;
+
+	if (!ok || fs_replace(tmp_path, path, 0, NULL) != FS_OK)
+	{
+		remove(tmp_path);
+		r = STATUS_FILE_E;
+		goto _done;
+	}
+
+	r = STATUS_FILE_OK;
+_done:
+	if (tmp_path != NULL)
+		free(tmp_path);
+	if (path != NULL)
+		free(path);
+	return r;
+}
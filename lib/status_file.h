@@ -0,0 +1,69 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef STATUS_FILE_H
+#define STATUS_FILE_H
+
+#include "intdef.h"
+
+#define STATUS_FILE_VERSION 2
+
+#define STATUS_FILE_DUE_MAX 500
+
+enum
+{
+	STATUS_FILE_OK = 0,
+	STATUS_FILE_E,
+	STATUS_FILE_ESTALE
+};
+
+/* Due dates of a database's agenda, kept in "<db>.status" so a status check
+ * doesn't need to open the database. Only good while the file change counter
+ * in the database header, bumped by every commit, keeps the value it had when
+ * the due dates were read. Databases in WAL mode don't bump it, they never have
+ * a current snapshot. */
+struct status_file
+{
+	u32 db_change_counter;
+	u32 reserved;
+	i64 written_at;
+	/* Entries due at or before `written_at`. */
+	u64 overdue_count;
+	/* Every entry due after `written_at` up to `until`, sorted. */
+	i64 until;
+	u64 due_count;
+	i64 due_array[STATUS_FILE_DUE_MAX];
+};
+
+/* OK | ESTALE. Loads the snapshot of `db_path` when it's still current and
+ * covers `now` through `until`. */
+int status_file_read(const char *db_path, i64 now, i64 until,
+                     struct status_file *ret_status);
+
+/* Number of entries due at or before `at`. */
+u64 status_file_count(const struct status_file *status, i64 at);
+
+/* ERROR | OK. Stamps `status` with the current file change counter of
+ * `db_path`, before reading the due dates it's going to hold. */
+int status_file_stamp(const char *db_path, struct status_file *status);
+
+/* ERROR | OK | ESTALE. Saves `status`, as long as the file change counter of
+ * `db_path` still has the value it was stamped with, otherwise a commit may
+ * have landed while the due dates were read and nothing is saved. */
+int status_file_write(const char *db_path, struct status_file *status);
+
+#endif /* !STATUS_FILE_H */
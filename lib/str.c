@@ -1,4 +1,5 @@
 #include "str.h"
+#include "memscan.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,12 +7,7 @@
 size_t
 cstr_len(const char *cstr)
 {
-	const char *c = NULL;
-
-	for (c = cstr; *c != '\0' && c - cstr < CSTR_LEN_MAX; c++)
-		;
-
-	return c - cstr;
+	return memscan_nul(cstr, CSTR_LEN_MAX);
 }
 
 int
@@ -140,11 +136,5 @@ str_free(struct str *str)
 void
 str_print(FILE *fd, struct str *str)
 {
-	char *cur = NULL;
-	char *end = NULL;
-
-	cur = &str->array[0];
-	end = &str->array[str->count];
-	for (; cur != end; cur++)
-		fputc(*cur, fd);
+	fwrite(str->array, 1, str->count, fd);
 }
@@ -0,0 +1,87 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "thread.h"
+#include <stdlib.h>
+#include <windows.h>
+
+struct thread_handle_windows
+{
+	HANDLE thread;
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+static DWORD WINAPI
+thread_main(LPVOID opaque_handle)
+{
+	struct thread_handle_windows *handle = NULL;
+
+	handle = opaque_handle;
+	handle->fn(handle->arg);
+	return 0;
+}
+
+int
+thread_start(void (*fn)(void *arg), void *arg, thread_handle **ret_handle)
+{
+	struct thread_handle_windows *handle = NULL;
+	int r = 0;
+
+	handle = malloc(sizeof *handle);
+	if (handle == NULL)
+	{
+		r = THREAD_EOOM;
+		goto _done;
+	}
+	handle->fn = fn;
+	handle->arg = arg;
+
+	handle->thread = CreateThread(NULL, 0, thread_main, handle, 0, NULL);
+	if (handle->thread == NULL)
+	{
+		r = THREAD_E;
+		goto _done;
+	}
+
+	*ret_handle = handle;
+	r = THREAD_OK;
+_done:
+	if (r != THREAD_OK && handle != NULL)
+		free(handle);
+	return r;
+}
+
+void
+thread_join(thread_handle *opaque_handle)
+{
+	struct thread_handle_windows *handle = NULL;
+
+	handle = opaque_handle;
+	WaitForSingleObject(handle->thread, INFINITE);
+	CloseHandle(handle->thread);
+	free(handle);
+}
+
+int
+thread_cpu_count(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors < 1 ? 1 : info.dwNumberOfProcessors;
+}
@@ -0,0 +1,194 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/agenda.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRY_MAX (200 * 1000)
+
+const char *current_group;
+unsigned long random_state = 1;
+/* Entries point at these, an entry's place here is its original order. */
+struct str title_array[ENTRY_MAX];
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* Same sequence on every platform, unlike rand(3). */
+int
+random_below(int n)
+{
+	random_state = (random_state * 1103515245ul + 12345ul) & 0x7ffffffful;
+	return (int)((random_state >> 16) % n);
+}
+
+/* By date, then by original order: what a stable sort gives. */
+int
+entry_compare(const void *a, const void *b)
+{
+	const struct agenda_entry *left = a;
+	const struct agenda_entry *right = b;
+
+	if (left->day != right->day)
+		return (left->day > right->day) - (left->day < right->day);
+	return (left->title > right->title) - (left->title < right->title);
+}
+
+/* `count` entries over `day_count` days around 1970-01-01, so most days
+ * repeat and half are before it. Every so often a day far out. */
+void
+random_entries(struct agenda_entry *array, size_t count, int day_count)
+{
+	size_t i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		array[i].day = random_below(day_count) - day_count / 2;
+		if (random_below(1000) == 0)
+			array[i].day =
+			    random_below(2) ? DAYNUM_MIN : DAYNUM_MAX;
+		array[i].title = &title_array[i];
+		array[i].tag_csv = NULL;
+		array[i].done = 0;
+	}
+}
+
+void
+assert_entries(const char *message, struct agenda_entry *expected,
+               struct agenda_entry *actual, size_t count)
+{
+	size_t i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		assert_equal(message, expected[i].day, actual[i].day);
+		assert_equal(message, (int)(expected[i].title - title_array),
+		             (int)(actual[i].title - title_array));
+	}
+}
+
+int
+main(void)
+{
+	static const size_t count_array[] = { 0, 1, 2, 3, 100, 5000,
+		                              ENTRY_MAX };
+	static const int thread_array[] = { 1, 2, 4, 0 };
+	struct agenda_entry *array = NULL;
+	struct agenda_entry *expected = NULL;
+	size_t count = 0;
+	size_t mid = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	array = malloc(sizeof *array * ENTRY_MAX);
+	expected = malloc(sizeof *expected * ENTRY_MAX);
+	if (array == NULL || expected == NULL)
+		fail("malloc", 0, 1);
+
+	test_group("agenda_entry_sort_parallel: same as a stable qsort");
+	for (i = 0; i < sizeof(count_array) / sizeof(count_array[0]); i++)
+	{
+		for (j = 0; j < sizeof(thread_array) / sizeof(thread_array[0]);
+		     j++)
+		{
+			count = count_array[i];
+			random_entries(array, count, 1 + (int)count / 4);
+			memcpy(expected, array, sizeof *array * count);
+			qsort(expected, count, sizeof *expected, entry_compare);
+			assert_equal("sort", AGENDA_OK,
+			             agenda_entry_sort_parallel(
+			                 array, count, thread_array[j]));
+			assert_entries("sort", expected, array, count);
+		}
+	}
+
+	test_group("agenda_entry_sort: wide day range");
+	random_entries(array, 5000, 2000000);
+	memcpy(expected, array, sizeof *array * 5000);
+	qsort(expected, 5000, sizeof *expected, entry_compare);
+	assert_equal("sort", AGENDA_OK, agenda_entry_sort(array, 5000));
+	assert_entries("sort", expected, array, 5000);
+
+	test_group("agenda_entry_merge: same as a stable qsort");
+	for (i = 0; i < sizeof(count_array) / sizeof(count_array[0]); i++)
+	{
+		count = count_array[i];
+		for (j = 0; j < 4; j++)
+		{
+			/* The edges, then somewhere in between. */
+			mid = (j == 0) ? 0 : (j == 1) ? count : count / (j + 1);
+			random_entries(array, count, 1 + (int)count / 4);
+			qsort(array, mid, sizeof *array, entry_compare);
+			qsort(&array[mid], count - mid, sizeof *array,
+			      entry_compare);
+			memcpy(expected, array, sizeof *array * count);
+			qsort(expected, count, sizeof *expected, entry_compare);
+			assert_equal("merge", AGENDA_OK,
+			             agenda_entry_merge(array, mid, count));
+			assert_entries("merge", expected, array, count);
+		}
+	}
+
+	test_group("agenda_entry_merge: second run after the first");
+	random_entries(array, 100, 50);
+	for (i = 50; i < 100; i++)
+		array[i].day += 1000;
+	qsort(array, 50, sizeof *array, entry_compare);
+	qsort(&array[50], 50, sizeof *array, entry_compare);
+	memcpy(expected, array, sizeof *array * 100);
+	assert_equal("merge", AGENDA_OK, agenda_entry_merge(array, 50, 100));
+	assert_entries("merge", expected, array, 100);
+
+	free(array);
+	free(expected);
+
+	test_done();
+	return 0;
+}
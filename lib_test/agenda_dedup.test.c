@@ -0,0 +1,148 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/agenda_dedup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RULE_COUNT 40
+#define DAY_COUNT  1500
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* Tags of rule `rule`, its name first, into `buffer`. */
+void
+tag_csv_of(struct str *tag_csv, char *buffer, int rule, const char *rest)
+{
+	tag_csv->array = buffer;
+	tag_csv->count = sprintf(buffer, "rule%d%s", rule, rest);
+}
+
+/* Rule `rule` fires on days that are a multiple of `rule` + 1, half of
+ * them before 1970. */
+int
+fires(int rule, daynum day)
+{
+	return (day % (rule + 1)) == 0;
+}
+
+int
+main(void)
+{
+	struct intern *intern = NULL;
+	struct agenda_dedup *dedup = NULL;
+	struct str tag_csv = { 0, NULL };
+	char buffer[64];
+	size_t expected_count = 0;
+	size_t intern_count = 0;
+	daynum day = 0;
+	int has = 0;
+	int rule = 0;
+	int r = 0;
+
+	assert_equal("intern", INTERN_OK, intern_alloc(&intern));
+	assert_equal("dedup", AGENDA_DEDUP_OK,
+	             agenda_dedup_alloc(intern, &dedup));
+
+	test_group("agenda_dedup_has: nothing yet, adds nothing");
+	tag_csv_of(&tag_csv, buffer, 0, "");
+	assert_equal("has", AGENDA_DEDUP_OK,
+	             agenda_dedup_has(dedup, 0, &tag_csv, &has));
+	assert_equal("has", 0, has);
+	assert_equal("intern count", 0, (int)intern->count);
+
+	test_group("agenda_dedup_put: many days");
+	for (day = -DAY_COUNT / 2; day < DAY_COUNT / 2; day++)
+	{
+		for (rule = 0; rule < RULE_COUNT; rule++)
+		{
+			if (!fires(rule, day))
+				continue;
+			tag_csv_of(&tag_csv, buffer, rule, ",x");
+			assert_equal("put", AGENDA_DEDUP_OK,
+			             agenda_dedup_put(dedup, day, &tag_csv));
+			expected_count++;
+		}
+	}
+	assert_equal("count", (int)expected_count, (int)dedup->count);
+	intern_count = intern->count;
+
+	test_group("agenda_dedup_has: keyed on the first tag and the day");
+	for (day = -DAY_COUNT / 2 - 3; day < DAY_COUNT / 2 + 3; day++)
+	{
+		for (rule = 0; rule < RULE_COUNT + 3; rule++)
+		{
+			/* Only the first tag counts, the rest may differ. */
+			tag_csv_of(&tag_csv, buffer, rule, ",y,z");
+			r = agenda_dedup_has(dedup, day, &tag_csv, &has);
+			assert_equal("has", AGENDA_DEDUP_OK, r);
+			assert_equal("has",
+			             rule < RULE_COUNT && fires(rule, day) &&
+			                 day >= -DAY_COUNT / 2 &&
+			                 day < DAY_COUNT / 2,
+			             has != 0);
+		}
+	}
+	assert_equal("intern count", (int)intern_count, (int)intern->count);
+
+	test_group("agenda_dedup_put: twice is once");
+	tag_csv_of(&tag_csv, buffer, 0, "");
+	assert_equal("put", AGENDA_DEDUP_OK,
+	             agenda_dedup_put(dedup, 0, &tag_csv));
+	assert_equal("count", (int)expected_count, (int)dedup->count);
+
+	agenda_dedup_free(dedup);
+	intern_free(intern);
+
+	test_done();
+	return 0;
+}
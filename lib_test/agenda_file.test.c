@@ -0,0 +1,638 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/agenda.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+/* Scratch files, in the directory tests run from. */
+#define TEST_PATH "agenda_file.test.txt"
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+void
+file_write(const char *path, const char *content)
+{
+	FILE *fd = NULL;
+
+	fd = fopen(path, "wb");
+	if (fd == NULL)
+		fail("fopen", 0, 1);
+	fputs(content, fd);
+	fclose(fd);
+}
+
+/* The whole file must be `expected`. */
+void
+assert_file(const char *message, const char *path, const char *expected)
+{
+	char buffer[4096];
+	FILE *fd = NULL;
+	size_t count = 0;
+
+	fd = fopen(path, "rb");
+	if (fd == NULL)
+		fail("fopen", 0, 1);
+	count = fread(buffer, 1, sizeof buffer, fd);
+	fclose(fd);
+	assert_equal(message, (int)strlen(expected), (int)count);
+	assert_equal(message, 0, memcmp(buffer, expected, count));
+}
+
+void
+remove_all(void)
+{
+	remove(TEST_PATH);
+	remove(TEST_PATH ".lock");
+	remove(TEST_PATH ".idx");
+}
+
+/* Appends a done record for 2025-01-02 "a" to a file holding `content`,
+ * the file must then hold `expected`. */
+void
+assert_append_done(const char *message, const char *content,
+                   const char *expected)
+{
+	struct str tag = { 1, "a" };
+	struct date date = { 2025, 1, 2 };
+
+	file_write(TEST_PATH, content);
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_append_done(TEST_PATH,
+	                                     daynum_from_date(&date), &tag, 0,
+	                                     NULL));
+	assert_file(message, TEST_PATH, expected);
+}
+
+/* Range reads of 2025-01-02 of the file the range test writes, whether the
+ * index is built or loaded. */
+void
+assert_range(const char *message)
+{
+	struct agenda_file *file = NULL;
+	struct date from = { 2025, 1, 2 };
+
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_range_alloc(TEST_PATH, daynum_from_date(&from),
+	                                     daynum_from_date(&from), &file,
+	                                     NULL));
+	assert_equal("entry count", 1, (int)file->entry_count);
+	assert_equal("done", 1, file->entry_array[0].done);
+	assert_equal("last_run", 5, file->last_run.day);
+	assert_equal("journal count", 2, (int)file->journal_count);
+	agenda_file_free(file);
+}
+
+/* Titles of the range read of days `from` to `to` of January 2025, in the
+ * order they're read, must be `expected`. */
+void
+assert_range_titles(const char *message, int from, int to,
+                    const char *expected)
+{
+	struct agenda_file *file = NULL;
+	struct date from_date = { 2025, 1, 0 };
+	struct date to_date = { 2025, 1, 0 };
+	char titles[64];
+	size_t count = 0;
+	size_t i = 0;
+
+	from_date.day = from;
+	to_date.day = to;
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_range_alloc(TEST_PATH,
+	                                     daynum_from_date(&from_date),
+	                                     daynum_from_date(&to_date), &file,
+	                                     NULL));
+	for (i = 0; i < file->entry_count; i++)
+	{
+		memcpy(&titles[count], file->entry_array[i].title->array,
+		       file->entry_array[i].title->count);
+		count += file->entry_array[i].title->count;
+	}
+	titles[count] = '\0';
+	agenda_file_free(file);
+	assert_equal(message, 0, strcmp(titles, expected));
+}
+
+/* Iterates the file, loading its done records after `skip` entries. The
+ * titles that follow, each with '+' when done and '-' when not, must be
+ * `expected`. */
+void
+assert_iter_done(const char *message, int skip, const char *expected)
+{
+	struct agenda_iter *iter = NULL;
+	struct agenda_entry entry = AGENDA_ENTRY_ZERO;
+	char titles[64];
+	size_t count = 0;
+	int i = 0;
+	int r = 0;
+
+	assert_equal(message, AGENDA_OK,
+	             agenda_iter_open_alloc(TEST_PATH, &iter, NULL));
+	for (i = 0; i < skip; i++)
+		assert_equal(message, AGENDA_OK,
+		             agenda_iter_next(iter, &entry, NULL));
+	assert_equal(message, AGENDA_OK, agenda_iter_done_load(iter, NULL));
+	while ((r = agenda_iter_next(iter, &entry, NULL)) == AGENDA_OK)
+	{
+		memcpy(&titles[count], entry.title->array, entry.title->count);
+		count += entry.title->count;
+		titles[count++] = entry.done ? '+' : '-';
+	}
+	titles[count] = '\0';
+	agenda_iter_close(iter);
+	assert_equal(message, AGENDA_OK_DONE, r);
+	assert_equal(message, 0, strcmp(titles, expected));
+}
+
+void
+file_append(const char *path, const char *content)
+{
+	FILE *fd = NULL;
+
+	fd = fopen(path, "ab");
+	if (fd == NULL)
+		fail("fopen", 0, 1);
+	fputs(content, fd);
+	fclose(fd);
+}
+
+int
+str_same(struct str *a, struct str *b)
+{
+	return a->count == b->count &&
+	       memcmp(a->array, b->array, a->count) == 0;
+}
+
+/* Same entries, done flags, last_run and journal count. */
+void
+assert_file_equal(const char *message, struct agenda_file *expected,
+                  struct agenda_file *actual)
+{
+	struct agenda_entry *expected_entry = NULL;
+	struct agenda_entry *actual_entry = NULL;
+	size_t i = 0;
+
+	assert_equal(message, (int)expected->entry_count,
+	             (int)actual->entry_count);
+	for (i = 0; i < expected->entry_count; i++)
+	{
+		expected_entry = &expected->entry_array[i];
+		actual_entry = &actual->entry_array[i];
+		assert_equal(message, expected_entry->day, actual_entry->day);
+		assert_equal(message, expected_entry->done, actual_entry->done);
+		assert_equal(message, 1,
+		             str_same(expected_entry->tag_csv,
+		                       actual_entry->tag_csv) &&
+		                 str_same(expected_entry->title,
+		                           actual_entry->title));
+	}
+	assert_equal(message, 0,
+	             date_compare(&expected->last_run, &actual->last_run));
+	assert_equal(message, (int)expected->journal_count,
+	             (int)actual->journal_count);
+}
+
+/* Reads the test file in every mode there is, each must give `expected`. */
+void
+assert_read_modes(const char *message, struct agenda_file *expected)
+{
+	struct agenda_file *file = NULL;
+	struct agenda_iter *iter = NULL;
+	struct agenda_entry entry = AGENDA_ENTRY_ZERO;
+	struct intern *intern = NULL;
+	size_t i = 0;
+	int r = 0;
+
+	assert_equal(message, INTERN_OK, intern_alloc(&intern));
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_read_intern_alloc(TEST_PATH, intern, &file,
+	                                           NULL));
+	assert_file_equal(message, expected, file);
+	agenda_file_free(file);
+	intern_free(intern);
+
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_map_alloc(TEST_PATH, &file, NULL));
+	assert_file_equal(message, expected, file);
+	agenda_file_free(file);
+
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_map_parallel_alloc(TEST_PATH, 2, &file, NULL));
+	assert_file_equal(message, expected, file);
+	agenda_file_free(file);
+
+	assert_equal(message, AGENDA_OK,
+	             agenda_file_range_alloc(TEST_PATH, DAYNUM_MIN, DAYNUM_MAX,
+	                                     &file, NULL));
+	assert_file_equal(message, expected, file);
+	agenda_file_free(file);
+
+	/* The iterator keeps no journal count. */
+	assert_equal(message, AGENDA_OK,
+	             agenda_iter_open_alloc(TEST_PATH, &iter, NULL));
+	assert_equal(message, AGENDA_OK, agenda_iter_done_load(iter, NULL));
+	for (i = 0; (r = agenda_iter_next(iter, &entry, NULL)) == AGENDA_OK;
+	     i++)
+	{
+		assert_equal(message, 1, i < expected->entry_count);
+		assert_equal(message, expected->entry_array[i].day, entry.day);
+		assert_equal(message, expected->entry_array[i].done,
+		             entry.done);
+		assert_equal(message, 1,
+		             str_same(expected->entry_array[i].tag_csv,
+		                      entry.tag_csv) &&
+		                 str_same(expected->entry_array[i].title,
+		                          entry.title));
+	}
+	assert_equal(message, AGENDA_OK_DONE, r);
+	assert_equal(message, (int)expected->entry_count, (int)i);
+	assert_equal(message, 0,
+	             date_compare(&expected->last_run, &iter->last_run));
+	agenda_iter_close(iter);
+}
+
+/* `after` is `before` written out: same entries and last_run, done records
+ * folded into the tags and no journal left. */
+void
+assert_folded(const char *message, struct agenda_file *before,
+              struct agenda_file *after)
+{
+	struct agenda_entry *before_entry = NULL;
+	struct agenda_entry *after_entry = NULL;
+	struct agenda_entry tagged = AGENDA_ENTRY_ZERO;
+	char tag_array[64];
+	struct str tag_csv = { 0, NULL };
+	size_t i = 0;
+
+	tag_csv.array = tag_array;
+
+	assert_equal(message, (int)before->entry_count,
+	             (int)after->entry_count);
+	for (i = 0; i < before->entry_count; i++)
+	{
+		before_entry = &before->entry_array[i];
+		after_entry = &after->entry_array[i];
+		tagged = *before_entry;
+		tagged.done = 0;
+		tag_csv.count = before_entry->tag_csv->count;
+		memcpy(tag_array, before_entry->tag_csv->array, tag_csv.count);
+		if (before_entry->done &&
+		    !agenda_entry_has_tag(&tagged, "done", 4))
+		{
+			if (tag_csv.count > 0)
+				tag_array[tag_csv.count++] = ',';
+			memcpy(&tag_array[tag_csv.count], "done", 4);
+			tag_csv.count += 4;
+		}
+		assert_equal(message, before_entry->day, after_entry->day);
+		assert_equal(message, 0, after_entry->done);
+		assert_equal(message, 1,
+		             str_same(&tag_csv, after_entry->tag_csv) &&
+		                 str_same(before_entry->title,
+		                          after_entry->title));
+	}
+	assert_equal(message, 0,
+	             date_compare(&before->last_run, &after->last_run));
+	assert_equal(message, 0, (int)after->journal_count);
+}
+
+/* Lines of the file the parallel test writes, all of the same length so the
+ * first line of each chunk is known: an entry is
+ * "YYYY-MM-DD\ttNNNNNN\txxxxxxxxxxxxxx\n", a done record
+ * "# ysarys: done YYYY-MM-DD\ttNNNNNN\n". */
+#define PARALLEL_LINE_SIZE  34
+#define PARALLEL_LINE_COUNT 27000
+
+/* Every chunk count the parallel test splits the file in. */
+#define PARALLEL_CHUNK_MAX 4
+
+/* Day and tag number of the entry on line `line`, pairs of lines share them
+ * so a done record may refer to an entry on either side of it. */
+daynum
+parallel_day(size_t line)
+{
+	return 20000 + (daynum)(line / 8);
+}
+
+int
+parallel_tag(size_t line)
+{
+	return (int)(line / 2);
+}
+
+void
+parallel_line(char *buffer, size_t line, int is_done, size_t entry_line)
+{
+	char date[DATE_FORMAT_MAX + 1];
+
+	daynum_format(date, parallel_day(entry_line));
+	if (is_done)
+		sprintf(buffer, "# ysarys: done %.10s\tt%06d\n", date,
+		        parallel_tag(entry_line));
+	else
+		sprintf(buffer, "%.10s\tt%06d\txxxxxxxxxxxxxx\n", date,
+		        parallel_tag(line));
+}
+
+/* Writes the parallel test file: entries, with done records on the two lines
+ * before and after each line a chunk starts at, for every chunk count. They
+ * refer to the entry before them, to one a few lines back, maybe in the
+ * chunk before, or to one after them, which they must not mark. */
+void
+parallel_write(void)
+{
+	static char is_done[PARALLEL_LINE_COUNT];
+	static const char head[] = "# ysarys: last_run 2025-01-01\n";
+	char line[PARALLEL_LINE_SIZE + 1];
+	size_t count = 0;
+	size_t chunk_count = 0;
+	size_t split = 0;
+	size_t entry_line = 0;
+	size_t i = 0;
+	int back = 0;
+	FILE *fd = NULL;
+
+	count = PARALLEL_LINE_SIZE * PARALLEL_LINE_COUNT + sizeof head - 1;
+	memset(is_done, 0, sizeof is_done);
+	for (chunk_count = 2; chunk_count <= PARALLEL_CHUNK_MAX; chunk_count++)
+	{
+		for (i = 1; i < chunk_count; i++)
+		{
+			/* Line right after the chunk's first '\n' aligned
+			 * byte, past the header. */
+			split = (count / chunk_count * i - (sizeof head - 1) +
+			         PARALLEL_LINE_SIZE - 1) /
+			        PARALLEL_LINE_SIZE;
+			is_done[split - 2] = 1;
+			is_done[split - 1] = 1;
+			is_done[split] = 1;
+			is_done[split + 1] = 1;
+		}
+	}
+
+	fd = fopen(TEST_PATH, "wb");
+	if (fd == NULL)
+		fail("fopen", 0, 1);
+	fputs(head, fd);
+	for (i = 0; i < PARALLEL_LINE_COUNT; i++)
+	{
+		entry_line = i;
+		if (is_done[i])
+		{
+			back = i % 3 == 0 ? 1 : i % 3 == 1 ? 5 : -3;
+			for (entry_line = i - back; is_done[entry_line];
+			     entry_line -= back > 0 ? 1 : -1)
+				;
+		}
+		parallel_line(line, i, is_done[i], entry_line);
+		assert_equal("line size", PARALLEL_LINE_SIZE,
+		             (int)strlen(line));
+		fputs(line, fd);
+	}
+	fclose(fd);
+}
+
+int
+main(void)
+{
+	struct agenda_file *file = NULL;
+	struct agenda_file *other = NULL;
+	struct agenda_entry entry_array[2];
+	struct date date = { 2025, 1, 8 };
+	struct str tag = { 1, "d" };
+	struct str title = { 8, "appended" };
+#if !defined(_WIN32)
+	struct stat st;
+#endif
+	int thread_count = 0;
+
+	test_group("agenda_file_append: last line without a new line");
+	assert_append_done("entry kept",
+	                   "# ysarys: last_run 2025-01-01\n"
+	                   "2025-01-02\ta\ttyped by hand",
+	                   "# ysarys: last_run 2025-01-01\n"
+	                   "2025-01-02\ta\ttyped by hand\n"
+	                   "# ysarys: done 2025-01-02\ta\n");
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &file, NULL));
+	assert_equal("entry count", 1, (int)file->entry_count);
+	assert_equal("done", 1, file->entry_array[0].done);
+	agenda_file_free(file);
+	assert_append_done("header kept",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: last_run 2025-01-03",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: last_run 2025-01-03\n"
+	                   "# ysarys: done 2025-01-02\ta\n");
+	assert_append_done("no new line at all", "2025-01-02\ta\tx",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: done 2025-01-02\ta\n");
+
+	test_group("agenda_file_append: torn last line");
+	assert_append_done("torn date",
+	                   "2025-01-02\ta\tx\n"
+	                   "2025-0",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: done 2025-01-02\ta\n");
+	assert_append_done("torn record",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: do",
+	                   "2025-01-02\ta\tx\n"
+	                   "# ysarys: done 2025-01-02\ta\n");
+	assert_append_done("torn only line", "2025-01",
+	                   "# ysarys: done 2025-01-02\ta\n");
+	assert_append_done("empty", "", "# ysarys: done 2025-01-02\ta\n");
+
+	test_group("agenda_file_range_alloc: records past the sorted entries");
+	remove_all();
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-02\ta\tx\n"
+	                      "2025-01-03\tb\ty\n"
+	                      "# ysarys: last_run 2025-01-05\n"
+	                      "2025-01-06\tc\tz\n"
+	                      "# ysarys: done 2025-01-02\ta\n");
+	assert_range("cold index");
+	assert_range("warm index");
+
+	test_group("agenda_index_load_alloc: appends and edits in place");
+	remove_all();
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-02\ta\tx\n"
+	                      "2025-01-03\tb\ty\n"
+	                      "2025-01-04\tc\tz\n");
+	assert_range_titles("built", 3, 3, "y");
+	file_append(TEST_PATH, "2025-01-05\td\tw\n");
+	assert_range_titles("extended, new day", 5, 5, "w");
+	assert_range_titles("extended, old day", 3, 3, "y");
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-02\ta\tx\n"
+	                      "2025-01-02\te\tv\n"
+	                      "2025-01-03\tb\ty\n"
+	                      "2025-01-04\tc\tz\n"
+	                      "2025-01-05\td\tw\n");
+	assert_range_titles("line added", 3, 3, "y");
+	assert_range_titles("line added, its day", 2, 2, "xv");
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-03\tb\ty\n"
+	                      "2025-01-04\tc\tz\n");
+	assert_range_titles("lines removed", 3, 4, "yz");
+	assert_range_titles("lines removed, their day", 2, 2, "");
+
+	test_group("agenda_iter_done_load: done records after their entries");
+	remove_all();
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-02\ta\tx\n"
+	                      "2025-01-02\tb\ty\n"
+	                      "2025-01-03\ta\tz\n"
+	                      "# ysarys: done 2025-01-02\ta\n"
+	                      "# ysarys: done 2025-01-03\ta\n");
+	assert_iter_done("from the start", 0, "x+y-z+");
+	assert_iter_done("after an entry", 1, "y-z+");
+
+	test_group("agenda_file_read_alloc: same as every other read");
+	remove_all();
+	file_write(TEST_PATH, "# ysarys: last_run 2025-01-01\n"
+	                      "2025-01-02\ta\tfirst\n"
+	                      "2025-01-02\tb,x\tsecond\n"
+	                      "2025-01-05\t\tno tags\n"
+	                      "2025-01-03\tc,done\tout of order\n"
+	                      "# ysarys: last_run 2025-01-04\n"
+	                      "2025-01-06\ta\tappended\n"
+	                      "2025-01-07\ta\n"
+	                      "# ysarys: done 2025-01-02\ta\n"
+	                      "# ysarys: done 2025-01-06\ta\n"
+	                      "# ysarys: last_run 2025-01-07\n");
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &file, NULL));
+	assert_equal("entry count", 6, (int)file->entry_count);
+	assert_equal("last_run", 7, file->last_run.day);
+	assert_equal("journal count", 4, (int)file->journal_count);
+	assert_read_modes("cold index", file);
+	assert_read_modes("warm index", file);
+	agenda_file_free(file);
+
+	test_group("agenda_file_write: round trip through every read");
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &file, NULL));
+#if !defined(_WIN32)
+	assert_equal("chmod", 0, chmod(TEST_PATH, 0640));
+#endif
+	assert_equal("write", AGENDA_OK,
+	             agenda_file_write(TEST_PATH, file, AGENDA_WRITE_SYNC,
+	                               NULL));
+#if !defined(_WIN32)
+	assert_equal("stat", 0, stat(TEST_PATH, &st));
+	assert_equal("mode kept", 0640, (int)(st.st_mode & 0777));
+#endif
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &other, NULL));
+	assert_folded("written", file, other);
+	assert_read_modes("written", other);
+	agenda_file_free(other);
+	agenda_file_free(file);
+
+	test_group("agenda_file_compact: round trip after appends");
+	entry_array[0].day = daynum_from_date(&date) + 1;
+	entry_array[0].tag_csv = &tag;
+	entry_array[0].title = &title;
+	entry_array[1] = entry_array[0];
+	entry_array[1].day = daynum_from_date(&date) - 1;
+	assert_equal("append", AGENDA_OK,
+	             agenda_file_append(TEST_PATH, &date, entry_array, 2, 0,
+	                                NULL));
+	assert_equal("append done", AGENDA_OK,
+	             agenda_file_append_done(TEST_PATH, entry_array[1].day,
+	                                     &tag, 0, NULL));
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &file, NULL));
+	assert_equal("journal count", 2, (int)file->journal_count);
+	assert_read_modes("appended", file);
+	assert_equal("compact", AGENDA_OK,
+	             agenda_file_compact(TEST_PATH, 0, NULL));
+	assert_equal("read", AGENDA_OK,
+	             agenda_file_read_alloc(TEST_PATH, &other, NULL));
+	assert_equal("sort", AGENDA_OK,
+	             agenda_entry_sort(file->entry_array, file->entry_count));
+	assert_folded("compacted", file, other);
+	assert_equal("sorted", 1, other->sorted);
+	/* The index of the appended file is stale, it must be rebuilt. */
+	assert_read_modes("compacted", other);
+	agenda_file_free(other);
+	agenda_file_free(file);
+
+	test_group("agenda_file_map_parallel_alloc: done records at chunk "
+	           "splits");
+	remove_all();
+	parallel_write();
+	assert_equal("map", AGENDA_OK,
+	             agenda_file_map_alloc(TEST_PATH, &file, NULL));
+	assert_equal("some done", 1, file->journal_count > 0);
+	for (thread_count = 1; thread_count <= PARALLEL_CHUNK_MAX;
+	     thread_count++)
+	{
+		assert_equal("map parallel", AGENDA_OK,
+		             agenda_file_map_parallel_alloc(
+		                 TEST_PATH, thread_count, &other, NULL));
+		assert_file_equal("same as map", file, other);
+		agenda_file_free(other);
+	}
+	agenda_file_free(file);
+
+	remove_all();
+
+	test_done();
+	return 0;
+}
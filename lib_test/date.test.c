@@ -0,0 +1,235 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/date.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+daynum
+day_of(int year, int month, int day)
+{
+	struct date value = DATE_ZERO;
+
+	value.year = year;
+	value.month = month;
+	value.day = day;
+	return daynum_from_date(&value);
+}
+
+/* The cursor agrees with `daynum_to_weekdate` on the day it's at. */
+void
+assert_calendar(const char *message, struct calendar *cal, daynum day)
+{
+	struct weekdate expected = WEEKDATE_ZERO;
+
+	daynum_to_weekdate(day, &expected);
+	assert_equal(message, day, cal->day);
+	assert_equal(message, expected.year, cal->table->year);
+	assert_equal(message, expected.month, cal->at->month);
+	assert_equal(message, expected.day, cal->at->day);
+	assert_equal(message, expected.week_day, cal->at->week_day);
+	assert_equal(message, date_month_last_day(expected.year,
+	                                          expected.month),
+	             cal->at->month_last_day);
+	assert_equal(message, expected.day - cal->at->month_last_day - 1,
+	             cal->at->negative_day);
+	assert_equal(message, day - day_of(expected.year, 1, 1) + 1,
+	             cal->at->day_of_year);
+}
+
+const struct year_day *
+year_day_of(struct calendar *cal, int year, int month, int day)
+{
+	calendar_init(cal, day_of(year, month, day));
+	return cal->at;
+}
+
+/* ISO 8601 week count of `year`, 53 when it starts on a thursday, or on a
+ * wednesday in a leap year. */
+int
+iso_week_count(int year)
+{
+	int week_day = daynum_week_day(day_of(year, 1, 1));
+	int leap = date_month_last_day(year, 2) == 29;
+
+	return (week_day == WEEK_DAY_THURSDAY ||
+	        (leap && week_day == WEEK_DAY_WEDNESDAY))
+	           ? 53
+	           : 52;
+}
+
+int
+iso_week(int year, int day_of_year, int week_day)
+{
+	/* Monday is 1, sunday is 7. */
+	int iso_week_day = (week_day + 5) % 7 + 1;
+	int week = (day_of_year - iso_week_day + 10) / 7;
+
+	if (week < 1)
+		return iso_week_count(year - 1);
+	if (week > iso_week_count(year))
+		return 1;
+	return week;
+}
+
+int
+main(void)
+{
+	static const int jump_array[] = {
+		-1, -2, -27, -31, -59, -365, -366,
+		-1461, -146097, 3, 400, -800, 146097
+	};
+	struct calendar cal = CALENDAR_ZERO;
+	daynum day = 0;
+	usize i = 0;
+
+	test_group("calendar_next: 1967 to 1973");
+	day = day_of(1967, 12, 25);
+	calendar_init(&cal, day);
+	assert_calendar("init", &cal, day);
+	for (; day < day_of(1973, 1, 5); day++)
+	{
+		assert_calendar("next", &cal, day);
+		calendar_next(&cal);
+	}
+	assert_calendar("end", &cal, day);
+
+	test_group("calendar_next: century leap years");
+	for (i = 0; i < 3; i++)
+	{
+		/* 1900 isn't a leap year, 2000 is, 2100 isn't. */
+		day = day_of(1900 + i * 100, 2, 27);
+		calendar_init(&cal, day);
+		for (; day < day_of(1900 + i * 100, 3, 2); day++)
+		{
+			assert_calendar("next", &cal, day);
+			calendar_next(&cal);
+		}
+		assert_equal("leap", i == 1, cal.table->leap);
+	}
+
+	test_group("calendar_jump: back and forth");
+	day = day_of(1970, 1, 1);
+	calendar_init(&cal, day);
+	for (i = 0; i < sizeof(jump_array) / sizeof(jump_array[0]); i++)
+	{
+		calendar_jump(&cal, jump_array[i]);
+		day += jump_array[i];
+		assert_calendar("jump", &cal, day);
+		calendar_next(&cal);
+		day += 1;
+		assert_calendar("next after jump", &cal, day);
+	}
+
+	test_group("calendar_jump: over a new year, both ways");
+	day = day_of(1969, 12, 31);
+	calendar_init(&cal, day);
+	for (i = 0; i < 10; i++)
+	{
+		calendar_jump(&cal, 1);
+		assert_calendar("forward", &cal, day + 1);
+		calendar_jump(&cal, -1);
+		assert_calendar("back", &cal, day);
+	}
+
+	test_group("year_day: iso_week");
+	assert_equal("2020-12-31", 53,
+	             year_day_of(&cal, 2020, 12, 31)->iso_week);
+	assert_equal("2021-01-03", 53,
+	             year_day_of(&cal, 2021, 1, 3)->iso_week);
+	assert_equal("2021-01-04", 1,
+	             year_day_of(&cal, 2021, 1, 4)->iso_week);
+	assert_equal("2024-12-29", 52,
+	             year_day_of(&cal, 2024, 12, 29)->iso_week);
+	assert_equal("2024-12-30", 1,
+	             year_day_of(&cal, 2024, 12, 30)->iso_week);
+	assert_equal("1969-12-29", 1,
+	             year_day_of(&cal, 1969, 12, 29)->iso_week);
+	assert_equal("1969-12-28", 52,
+	             year_day_of(&cal, 1969, 12, 28)->iso_week);
+	assert_equal("2016-01-03", 53,
+	             year_day_of(&cal, 2016, 1, 3)->iso_week);
+	day = day_of(1967, 12, 20);
+	calendar_init(&cal, day);
+	for (; day < day_of(2030, 1, 10); day++)
+	{
+		assert_equal("walk",
+		             iso_week(cal.table->year, cal.at->day_of_year,
+		                      cal.at->week_day),
+		             cal.at->iso_week);
+		calendar_next(&cal);
+	}
+
+	test_group("year_day: nth_week_day");
+	assert_equal("2024-05-03", 1,
+	             year_day_of(&cal, 2024, 5, 3)->nth_week_day);
+	assert_equal("2024-05-07", 1,
+	             year_day_of(&cal, 2024, 5, 7)->nth_week_day);
+	assert_equal("2024-05-08", 2,
+	             year_day_of(&cal, 2024, 5, 8)->nth_week_day);
+	assert_equal("2024-05-31", 5,
+	             year_day_of(&cal, 2024, 5, 31)->nth_week_day);
+	assert_equal("2024-02-29", 5,
+	             year_day_of(&cal, 2024, 2, 29)->nth_week_day);
+	day = day_of(1967, 12, 20);
+	calendar_init(&cal, day);
+	for (; day < day_of(1973, 1, 10); day++)
+	{
+		assert_equal("walk", (cal.at->day - 1) / 7 + 1,
+		             cal.at->nth_week_day);
+		calendar_next(&cal);
+	}
+
+	test_done();
+	return 0;
+}
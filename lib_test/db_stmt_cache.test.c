@@ -0,0 +1,109 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../lib/db_stmt_cache.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Distinct statements, well past the first allocation of the cache. */
+#define TEST_SQL_COUNT 100
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* Gets the statement for `sql`, which selects `expected`, and steps it. */
+void
+assert_select(struct db_stmt_cache *cache, const char *sql, int expected)
+{
+	sqlite3_stmt *stmt = NULL;
+
+	assert_equal("get", DB_STMT_CACHE_OK,
+	             db_stmt_cache_get(cache, sql, &stmt));
+	assert_equal("step", SQLITE_ROW, sqlite3_step(stmt));
+	assert_equal("column", expected, sqlite3_column_int(stmt, 0));
+	db_stmt_cache_release(stmt);
+}
+
+int
+main(void)
+{
+	static char sql_array[TEST_SQL_COUNT][16];
+	struct db_stmt_cache cache = DB_STMT_CACHE_ZERO;
+	sqlite3 *db = NULL;
+	int i = 0;
+
+	assert_equal("open", SQLITE_OK, sqlite3_open(":memory:", &db));
+	db_stmt_cache_init(&cache, db);
+	for (i = 0; i < TEST_SQL_COUNT; i++)
+		sprintf(sql_array[i], "SELECT %d", i);
+
+	test_group("db_stmt_cache_get: more statements than fit at first");
+	for (i = 0; i < TEST_SQL_COUNT; i++)
+		assert_select(&cache, sql_array[i], i);
+	assert_equal("prepare count", TEST_SQL_COUNT, (int)cache.prepare_count);
+	assert_equal("reuse count", 0, (int)cache.reuse_count);
+
+	test_group("db_stmt_cache_get: reuse after growing");
+	for (i = TEST_SQL_COUNT - 1; i >= 0; i--)
+		assert_select(&cache, sql_array[i], i);
+	assert_select(&cache, "SELECT 7", 7);
+	assert_equal("prepare count", TEST_SQL_COUNT, (int)cache.prepare_count);
+	assert_equal("reuse count", TEST_SQL_COUNT + 1,
+	             (int)cache.reuse_count);
+
+	test_group("db_stmt_cache_finalize: connection closes");
+	db_stmt_cache_finalize(&cache);
+	assert_equal("entry count", 0, (int)cache.entry_count);
+	assert_equal("close", SQLITE_OK, sqlite3_close(db));
+
+	test_done();
+	return 0;
+}
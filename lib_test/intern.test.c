@@ -0,0 +1,137 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/intern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRING_COUNT 20000
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* String number `i`, into `buffer`. */
+int
+string_of(char *buffer, int i)
+{
+	return sprintf(buffer, "tag-%d", i);
+}
+
+int
+main(void)
+{
+	static struct str *str_array[STRING_COUNT];
+	struct intern *intern = NULL;
+	struct str *str = NULL;
+	char buffer[32];
+	u32 id = 0;
+	int count = 0;
+	int i = 0;
+
+	test_group("intern_put: ids across resizes");
+	assert_equal("alloc", INTERN_OK, intern_alloc(&intern));
+	for (i = 0; i < STRING_COUNT; i++)
+	{
+		count = string_of(buffer, i);
+		assert_equal("put", INTERN_OK,
+		             intern_put(intern, buffer, count, &id));
+		assert_equal("new id", i, (int)id);
+		str_array[i] = intern_str(intern, id);
+		assert_equal("count", count, (int)str_array[i]->count);
+		assert_equal("copy", 0, memcmp(str_array[i]->array, buffer,
+		                               count));
+	}
+	assert_equal("count", STRING_COUNT, (int)intern->count);
+
+	/* After every resize, the same ids and the same strings. */
+	for (i = 0; i < STRING_COUNT; i++)
+	{
+		count = string_of(buffer, i);
+		assert_equal("put again", INTERN_OK,
+		             intern_put(intern, buffer, count, &id));
+		assert_equal("same id", i, (int)id);
+		assert_equal("put_str", INTERN_OK,
+		             intern_put_str(intern, buffer, count, &str));
+		assert_equal("same str", 1, str == str_array[i]);
+		assert_equal("str", 1, intern_str(intern, i) == str_array[i]);
+	}
+	assert_equal("count", STRING_COUNT, (int)intern->count);
+
+	test_group("intern_get: adds nothing");
+	for (i = 0; i < STRING_COUNT; i += 97)
+	{
+		count = string_of(buffer, i);
+		assert_equal("get", INTERN_OK,
+		             intern_get(intern, buffer, count, &id));
+		assert_equal("id", i, (int)id);
+	}
+	for (i = STRING_COUNT; i < STRING_COUNT * 2; i += 97)
+	{
+		count = string_of(buffer, i);
+		assert_equal("missing", INTERN_ENOENT,
+		             intern_get(intern, buffer, count, &id));
+	}
+	assert_equal("count", STRING_COUNT, (int)intern->count);
+
+	test_group("intern_put: prefixes and the empty string");
+	assert_equal("put", INTERN_OK, intern_put(intern, "tag-1", 4, &id));
+	assert_equal("prefix is new", STRING_COUNT, (int)id);
+	assert_equal("put", INTERN_OK, intern_put(intern, "", 0, &id));
+	assert_equal("empty is new", STRING_COUNT + 1, (int)id);
+	assert_equal("put", INTERN_OK, intern_put(intern, "", 0, &id));
+	assert_equal("empty again", STRING_COUNT + 1, (int)id);
+	assert_equal("empty count", 0, (int)intern_str(intern, id)->count);
+
+	intern_free(intern);
+
+	test_done();
+	return 0;
+}
@@ -0,0 +1,170 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../lib/memscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The vector paths are picked at compile time. Build with -mavx2 for the 32
+ * bytes loop, or -mno-sse2 for the word at a time one, to cover them. */
+
+/* Starts tried, one per byte of a 64 bytes line, and counts tried, enough to
+ * cross a few 16, 32 and 64 bytes blocks from each. */
+#define ALIGN_COUNT 64
+#define COUNT_MAX   160
+
+/* Bytes past `count`, the byte looked for after one more of the fill, so a
+ * read past the end would give a wrong index. */
+#define PAST_COUNT 32
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* The byte loop memscan_byte must agree with. */
+size_t
+byte_loop(const char *array, size_t count, char c)
+{
+	size_t i = 0;
+
+	for (i = 0; i < count && array[i] != c; i++)
+		;
+	return i;
+}
+
+/* Start of `buffer` on a 64 bytes boundary, `buffer` must have 64 bytes to
+ * spare. */
+char *
+align_64(char *buffer)
+{
+	return &buffer[(64 - ((size_t)buffer & 63)) & 63];
+}
+
+/* `c` at `at`, and with `repeat` set every byte after it, in `count` bytes of
+ * `fill` from every alignment. The `c`s past `count` must be left alone. */
+void
+assert_byte_at(char *line, char c, char fill, size_t at, int repeat)
+{
+	size_t align = 0;
+	size_t count = 0;
+	size_t i = 0;
+	char *array = NULL;
+
+	for (align = 0; align < ALIGN_COUNT; align++)
+	{
+		array = &line[align];
+		for (count = 0; count <= COUNT_MAX; count++)
+		{
+			memset(array, fill, COUNT_MAX + 1);
+			for (i = at; i < count && (i == at || repeat); i++)
+				array[i] = c;
+			memset(&array[count + 1], c, PAST_COUNT - 1);
+			assert_equal("memscan_byte",
+			             (int)byte_loop(array, count, c),
+			             (int)memscan_byte(array, count, c));
+		}
+	}
+}
+
+int
+main(void)
+{
+	static const char c_array[] = { '\n', '\0', '\t', (char)0x80,
+	                                (char)0xff };
+	static char buffer[64 + ALIGN_COUNT + COUNT_MAX + PAST_COUNT];
+	char fill_array[3];
+	char *line = NULL;
+	size_t c_i = 0;
+	size_t fill_i = 0;
+	size_t at = 0;
+	size_t align = 0;
+	size_t max = 0;
+	int repeat = 0;
+
+	line = align_64(buffer);
+
+	test_group("memscan_byte: every offset and alignment");
+	for (c_i = 0; c_i < sizeof c_array; c_i++)
+	{
+		/* Bytes one bit off `c` are the near misses of the word at a
+		 * time test. */
+		fill_array[0] = 'a';
+		fill_array[1] = (char)(c_array[c_i] ^ 0x80);
+		fill_array[2] = (char)(c_array[c_i] ^ 1);
+		for (fill_i = 0; fill_i < sizeof fill_array; fill_i++)
+			for (at = 0; at <= COUNT_MAX; at++)
+				for (repeat = 0; repeat < 2; repeat++)
+					assert_byte_at(line, c_array[c_i],
+					               fill_array[fill_i], at,
+					               repeat);
+	}
+
+	test_group("memscan_byte: no match and zero length");
+	memset(line, 'a', COUNT_MAX);
+	assert_equal("no match", COUNT_MAX,
+	             (int)memscan_byte(line, COUNT_MAX, '\n'));
+	assert_equal("zero length", 0, (int)memscan_byte(line, 0, 'a'));
+
+	test_group("memscan_nul: every offset, alignment and max");
+	for (align = 0; align < ALIGN_COUNT; align++)
+	{
+		for (at = 0; at <= COUNT_MAX - ALIGN_COUNT; at++)
+		{
+			memset(line, 'a', ALIGN_COUNT + COUNT_MAX);
+			line[align + at] = '\0';
+			for (max = 0; max <= COUNT_MAX - ALIGN_COUNT; max++)
+				assert_equal(
+				    "memscan_nul", (int)(at < max ? at : max),
+				    (int)memscan_nul(&line[align], max));
+		}
+	}
+
+	test_done();
+	return 0;
+}
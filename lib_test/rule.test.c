@@ -16,8 +16,10 @@
  */
 
 #include "../lib/rule.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 const char *current_group;
 struct weekdate date_value = WEEKDATE_ZERO;
@@ -66,10 +68,141 @@ date(int year, int month, int day, int week_day)
 	return &date_value;
 }
 
+daynum
+day_of(int year, int month, int day)
+{
+	struct date value = DATE_ZERO;
+
+	value.year = year;
+	value.month = month;
+	value.day = day;
+	return daynum_from_date(&value);
+}
+
+/* First day from `from` to `to` that `rule_matches`, or `to` + 1. */
+daynum
+next_match_scan(struct rule *rule, daynum from, daynum to)
+{
+	struct weekdate value = WEEKDATE_ZERO;
+
+	for (; from <= to; from++)
+	{
+		daynum_to_weekdate(from, &value);
+		if (rule_matches(rule, &value))
+			break;
+	}
+	return from;
+}
+
+void
+assert_next_match(const char *input, daynum from, int expected_r,
+                  daynum expected_day)
+{
+	struct rule *rule = NULL;
+	daynum day = 0;
+	int r = 0;
+
+	assert_equal("compile", 0, rule_compile(input, strlen(input), &rule));
+	r = rule_next_match(rule, from, &day);
+	assert_equal(input, expected_r, r);
+	if (r == RULE_OK)
+		assert_equal(input, expected_day, day);
+	rule_free(rule);
+}
+
+/* Compiles `input`, stores it as a blob and loads it back. */
+void
+assert_blob_round_trip(const char *input)
+{
+	struct rule *rule = NULL;
+	struct rule *loaded = NULL;
+	struct weekdate value = WEEKDATE_ZERO;
+	daynum day = 0;
+	usize i = 0;
+
+	assert_equal("compile", 0, rule_compile(input, strlen(input), &rule));
+	for (i = offsetof(struct rule, week_day_mask) + 1;
+	     i < offsetof(struct rule, day_mask); i++)
+		assert_equal("padding", 0, ((unsigned char *)rule)[i]);
+	assert_equal(input, RULE_OK,
+	             rule_load_alloc(rule, rule_size(rule), &loaded));
+	assert_equal(input, 0, memcmp(rule, loaded, rule_size(rule)));
+	for (day = day_of(1968, 1, 1); day < day_of(1973, 1, 1); day++)
+	{
+		daynum_to_weekdate(day, &value);
+		assert_equal(input, rule_matches(rule, &value),
+		             rule_matches(loaded, &value));
+	}
+	rule_free(loaded);
+	rule_free(rule);
+}
+
+/* Loads `rule` after `edit` changed its blob copy, expecting a rejection. */
+void
+assert_blob_rejected(const char *message, struct rule *rule, usize count,
+                     void (*edit)(struct rule *))
+{
+	struct rule *copy = NULL;
+	struct rule *loaded = NULL;
+
+	/* Room for `count` bytes, the blob may claim more than the rule. */
+	copy = calloc(1, rule_size(rule) + count);
+	memcpy(copy, rule, rule_size(rule));
+	if (edit != NULL)
+		edit(copy);
+	assert_equal(message, RULE_EINVALBLOB,
+	             rule_load_alloc(copy, count, &loaded));
+	assert_equal(message, 1, loaded == NULL);
+	free(copy);
+}
+
+void
+edit_index_past_end(struct rule *rule)
+{
+	rule->day.index = rule->item_count;
+}
+
+void
+edit_count_past_end(struct rule *rule)
+{
+	rule->day.count = rule->item_count + 1;
+}
+
+void
+edit_nested_multi(struct rule *rule)
+{
+	rule_item(rule, &rule->day, 0)->type = MATCHER_TYPE_MULTI;
+}
+
+void
+edit_unknown_type(struct rule *rule)
+{
+	rule->month.type = MATCHER_TYPE_MULTI + 1;
+}
+
+void
+edit_item_count(struct rule *rule)
+{
+	rule->item_count += 1;
+}
+
 int
 main(void)
 {
+	static const char *const next_inputs[] = {
+		"*",       "d1",          "d-1",       "m2 d29",
+		"d-7.-1 w3", "w1,7",      "d13 w6",    "m1,12 d-1 w2",
+		"y1969.1971 d31 w1",      "d5.10 w-1", "m2.3 d-3.-1 w-2.-1"
+	};
 	struct rule *rule = NULL;
+	struct weekdate value = WEEKDATE_ZERO;
+	u64 bitmap[32];
+	daynum from = 0;
+	daynum to = 0;
+	daynum day = 0;
+	daynum expected = 0;
+	usize i = 0;
+	int r = 0;
 
 	test_group("rule: <empty>");
 	assert_equal("compile", 0, rule_compile("*", 1, &rule));
@@ -84,20 +217,18 @@ main(void)
 	             rule_compile("y* m1 d2,3 w-3.-1", 17, &rule));
 	assert_equal("year", MATCHER_TYPE_ALL, rule->year.type);
 	assert_equal("month", MATCHER_TYPE_SIMPLE, rule->month.type);
-	assert_equal("month.value", 1, rule->month.data.simple.value);
+	assert_equal("month.value", 1, rule->month.from);
 	assert_equal("day", MATCHER_TYPE_MULTI, rule->day.type);
-	assert_equal("day.count", 2, rule->day.data.multi.count);
+	assert_equal("day.count", 2, rule->day.count);
 	assert_equal("day.0", MATCHER_TYPE_SIMPLE,
-	             rule->day.data.multi.array[0].type);
-	assert_equal("day.0.value", 2,
-	             rule->day.data.multi.array[0].data.simple.value);
+	             rule_item(rule, &rule->day, 0)->type);
+	assert_equal("day.0.value", 2, rule_item(rule, &rule->day, 0)->from);
 	assert_equal("day.1", MATCHER_TYPE_SIMPLE,
-	             rule->day.data.multi.array[1].type);
-	assert_equal("day.1.value", 3,
-	             rule->day.data.multi.array[1].data.simple.value);
+	             rule_item(rule, &rule->day, 1)->type);
+	assert_equal("day.1.value", 3, rule_item(rule, &rule->day, 1)->from);
 	assert_equal("week_day", MATCHER_TYPE_RANGE, rule->week_day.type);
-	assert_equal("week_day.from", -3, rule->week_day.data.range.from);
-	assert_equal("week_day.to", -1, rule->week_day.data.range.to);
+	assert_equal("week_day.from", -3, rule->week_day.from);
+	assert_equal("week_day.to", -1, rule->week_day.to);
 	rule_free(rule);
 
 	test_group("rule: d1");
@@ -150,6 +281,125 @@ main(void)
 	             rule_matches(rule, date(2024, 1, 20, WEEK_DAY_TUESDAY)));
 	rule_free(rule);
 
+	test_group("rule_next_match: sparse years");
+	assert_next_match("y2030,2800 m2 d29", day_of(2030, 1, 1), RULE_OK,
+	                  day_of(2800, 2, 29));
+	assert_next_match("y2030.2031,2400 m2 d29", day_of(2024, 3, 1),
+	                  RULE_OK, day_of(2400, 2, 29));
+	assert_next_match("y2001.2003,2101.2103 m2 d29", day_of(2000, 1, 1),
+	                  RULE_OK_NONE, 0);
+	assert_next_match("y2030,2800 m2 d29", day_of(2800, 3, 1),
+	                  RULE_OK_NONE, 0);
+	assert_next_match("m2 d30", day_of(2024, 1, 1), RULE_OK_NONE, 0);
+	assert_next_match("y1900.2100 m2 d29", day_of(1897, 1, 1), RULE_OK,
+	                  day_of(1904, 2, 29));
+
+	test_group("rule_next_match: years past what a daynum holds");
+	assert_next_match("y9999999", 20000, RULE_OK_NONE, 0);
+	assert_next_match("y9999999.99999999 m1 d1", 20000, RULE_OK_NONE, 0);
+	assert_next_match("y2030,9999999 m1 d1", 20000, RULE_OK,
+	                  day_of(2030, 1, 1));
+	assert_next_match("y2030,9999999 m1 d1", day_of(2030, 1, 2),
+	                  RULE_OK_NONE, 0);
+	assert_next_match("y5000000 m1 d1", 20000, RULE_OK,
+	                  day_of(5000000, 1, 1));
+	assert_next_match("d-1", day_of(DATE_YEAR_MAX, 12, 30), RULE_OK,
+	                  day_of(DATE_YEAR_MAX, 12, 31));
+	assert_next_match("d1", day_of(DATE_YEAR_MAX, 12, 30), RULE_OK_NONE,
+	                  0);
+	assert_next_match("y-9999999 m1 d1", 20000, RULE_OK_NONE, 0);
+
+	test_group("rule_next_match: same as rule_matches");
+	for (i = 0; i < sizeof(next_inputs) / sizeof(next_inputs[0]); i++)
+	{
+		assert_equal("compile", 0,
+		             rule_compile(next_inputs[i],
+		                          strlen(next_inputs[i]), &rule));
+		for (from = day_of(1968, 12, 20); from < day_of(1972, 1, 10);
+		     from += 7)
+		{
+			expected = next_match_scan(rule, from, from + 800);
+			r = rule_next_match(rule, from, &day);
+			if (expected > from + 800 && r == RULE_OK)
+				assert_equal(next_inputs[i], 1,
+				             day > from + 800);
+			else if (expected > from + 800)
+				assert_equal(next_inputs[i], RULE_OK_NONE, r);
+			else
+			{
+				assert_equal(next_inputs[i], RULE_OK, r);
+				assert_equal(next_inputs[i], expected, day);
+			}
+		}
+		rule_free(rule);
+	}
+
+	test_group("rule_load_alloc: round trip");
+	for (i = 0; i < sizeof(next_inputs) / sizeof(next_inputs[0]); i++)
+		assert_blob_round_trip(next_inputs[i]);
+	assert_blob_round_trip("y2030,2800 m2 d29");
+	assert_blob_round_trip("y1969.1970,1972 m1,3.4,12 d1,-1,15.20 w2,6");
+
+	test_group("rule_load_alloc: rejects bad blobs");
+	assert_equal("compile", 0, rule_compile("m1 d1,15,-1", 11, &rule));
+	assert_blob_rejected("empty", rule, 0, NULL);
+	assert_blob_rejected("short header", rule, sizeof(struct rule) - 1,
+	                     NULL);
+	assert_blob_rejected("short items", rule, rule_size(rule) - 1, NULL);
+	assert_blob_rejected("long", rule, rule_size(rule) + 1, NULL);
+	assert_blob_rejected("index", rule, rule_size(rule),
+	                     edit_index_past_end);
+	assert_blob_rejected("count", rule, rule_size(rule),
+	                     edit_count_past_end);
+	assert_blob_rejected("nested", rule, rule_size(rule),
+	                     edit_nested_multi);
+	assert_blob_rejected("type", rule, rule_size(rule), edit_unknown_type);
+	assert_blob_rejected("item count", rule, rule_size(rule),
+	                     edit_item_count);
+	rule_free(rule);
+
+	test_group("rule_match_range: same as rule_matches");
+	for (i = 0; i < sizeof(next_inputs) / sizeof(next_inputs[0]); i++)
+	{
+		assert_equal("compile", 0,
+		             rule_compile(next_inputs[i],
+		                          strlen(next_inputs[i]), &rule));
+		for (from = day_of(1968, 12, 20); from < day_of(1969, 3, 1);
+		     from += 13)
+		{
+			to = from + 1500 + (from % 64);
+			rule_match_range(rule, from, to, bitmap);
+			for (day = from; day <= to; day++)
+			{
+				daynum_to_weekdate(day, &value);
+				assert_equal(next_inputs[i],
+				             rule_matches(rule, &value),
+				             (bitmap[(day - from) / 64] >>
+				              ((day - from) % 64)) & 1);
+			}
+			/* Nothing past `to` in the last word. */
+			if ((to - from + 1) % 64 != 0)
+				assert_equal(next_inputs[i], 0,
+				             (bitmap[(to - from) / 64] >>
+				              ((to - from + 1) % 64)) != 0);
+		}
+		rule_free(rule);
+	}
+
+	test_group("rule_match_range: to before from");
+	assert_equal("compile", 0, rule_compile("*", 1, &rule));
+	assert_equal("word count", 0,
+	             RULE_RANGE_WORD_COUNT(day_of(2024, 1, 2),
+	                                   day_of(2024, 1, 1)));
+	bitmap[0] = 0xa5;
+	rule_match_range(rule, day_of(2024, 1, 2), day_of(2024, 1, 1),
+	                 bitmap);
+	assert_equal("untouched", 0xa5, (int)bitmap[0]);
+	rule_match_range(rule, day_of(2024, 1, 1), day_of(2024, 1, 1),
+	                 bitmap);
+	assert_equal("one day", 1, (int)bitmap[0]);
+	rule_free(rule);
+
 	test_done();
 	return 0;
 }
@@ -0,0 +1,227 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "../lib/rule_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RULE_MAX 300
+
+const char *current_group;
+unsigned long random_state = 1;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+/* Same sequence on every platform, unlike rand(3). */
+int
+random_below(int n)
+{
+	random_state = (random_state * 1103515245ul + 12345ul) & 0x7ffffffful;
+	return (int)((random_state >> 16) % n);
+}
+
+/* A value or a range for field `field`, into `buffer`. */
+int
+random_item(char *buffer, char field)
+{
+	int from = 0;
+	int to = 0;
+
+	switch (field)
+	{
+		case 'y':
+			from = 2022 + random_below(5);
+			to = from + random_below(3);
+			break;
+
+		case 'm':
+			from = 1 + random_below(12);
+			to = from + random_below(13 - from);
+			break;
+
+		case 'w':
+			from = 1 + random_below(7);
+			to = from + random_below(8 - from);
+			break;
+
+		default:
+			from = 1 + random_below(31);
+			to = from + random_below(32 - from);
+			if (random_below(3) == 0)
+			{
+				from = -from;
+				to = -to;
+				return sprintf(buffer, "%d.%d", to, from);
+			}
+			break;
+	}
+
+	if (from == to || random_below(2) == 0)
+		return sprintf(buffer, "%d", from);
+	return sprintf(buffer, "%d.%d", from, to);
+}
+
+/* A rule with some of its fields set, each to a list of one to three
+ * items. */
+struct rule *
+random_rule(void)
+{
+	static const char field_array[] = "ymdw";
+	struct rule *rule = NULL;
+	char input[128];
+	int count = 0;
+	int item_count = 0;
+	int i = 0;
+	int j = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (random_below(3) == 0)
+			continue;
+		if (count > 0)
+			input[count++] = ' ';
+		input[count++] = field_array[i];
+		item_count = 1 + random_below(3);
+		for (j = 0; j < item_count; j++)
+		{
+			if (j > 0)
+				input[count++] = ',';
+			count += random_item(&input[count], field_array[i]);
+		}
+	}
+	if (count == 0)
+		input[count++] = '*';
+
+	assert_equal(input, RULE_OK, rule_compile(input, count, &rule));
+	return rule;
+}
+
+/* Every day from `from` to `to`, the index hands back exactly the rules
+ * `rule_matches_calendar` accepts. */
+void
+assert_index(struct rule **rule_array, usize rule_count, daynum from,
+             daynum to)
+{
+	struct rule_index *index = NULL;
+	struct calendar cal = CALENDAR_ZERO;
+	u64 bitmap[RULE_MAX / 64 + 2];
+	u64 untouched = 0;
+	usize match_count = 0;
+	usize expected_count = 0;
+	usize i = 0;
+	int expected = 0;
+
+	memset(&untouched, 0xa5, sizeof(untouched));
+	assert_equal("alloc", RULE_INDEX_OK,
+	             rule_index_alloc(rule_array, rule_count, &index));
+	assert_equal("word count", (int)((rule_count + 63) / 64),
+	             (int)index->word_count);
+
+	for (calendar_init(&cal, from); cal.day <= to; calendar_next(&cal))
+	{
+		/* A word past the index must be left alone. */
+		memset(bitmap, 0xa5, sizeof(bitmap));
+		match_count = rule_index_match(index, &cal, bitmap);
+		expected_count = 0;
+		for (i = 0; i < rule_count; i++)
+		{
+			expected = rule_matches_calendar(rule_array[i], &cal);
+			expected_count += expected;
+			assert_equal("match", expected,
+			             (int)((bitmap[i / 64] >> (i % 64)) & 1));
+		}
+		assert_equal("count", (int)expected_count, (int)match_count);
+		for (i = index->word_count; i < RULE_MAX / 64 + 2; i++)
+			assert_equal("past the end", 1, bitmap[i] == untouched);
+		/* Bits past `rule_count` in the last word stay clear. */
+		for (i = rule_count; i < index->word_count * 64; i++)
+			assert_equal("past rule_count", 0,
+			             (int)((bitmap[i / 64] >> (i % 64)) & 1));
+	}
+
+	rule_index_free(index);
+}
+
+int
+main(void)
+{
+	static const usize count_array[] = { 0, 1, 63, 64, 65, RULE_MAX };
+	struct rule *rule_array[RULE_MAX];
+	struct date from = DATE_ZERO;
+	struct date to = DATE_ZERO;
+	char group[64];
+	usize i = 0;
+
+	for (i = 0; i < RULE_MAX; i++)
+		rule_array[i] = random_rule();
+
+	/* 2024 is a leap year, the rules' years run from 2022 to 2028. */
+	from.year = 2023;
+	from.month = MONTH_DECEMBER;
+	from.day = 25;
+	to.year = 2025;
+	to.month = MONTH_JANUARY;
+	to.day = 5;
+
+	for (i = 0; i < sizeof(count_array) / sizeof(count_array[0]); i++)
+	{
+		sprintf(group, "rule_index_match: %d rules",
+		        (int)count_array[i]);
+		test_group(group);
+		assert_index(rule_array, count_array[i],
+		             daynum_from_date(&from), daynum_from_date(&to));
+	}
+
+	for (i = 0; i < RULE_MAX; i++)
+		rule_free(rule_array[i]);
+
+	test_done();
+	return 0;
+}
@@ -0,0 +1,121 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../lib/status_file.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Scratch files, in the directory tests run from. */
+#define TEST_PATH "status_file.test.db"
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+void
+db_exec(sqlite3 *db, const char *sql)
+{
+	assert_equal(sql, SQLITE_OK, sqlite3_exec(db, sql, NULL, NULL, NULL));
+}
+
+void
+remove_all(void)
+{
+	remove(TEST_PATH);
+	remove(TEST_PATH ".status");
+}
+
+int
+main(void)
+{
+	struct status_file status;
+	struct status_file read;
+	sqlite3 *db = NULL;
+
+	remove_all();
+	assert_equal("open", SQLITE_OK, sqlite3_open(TEST_PATH, &db));
+	db_exec(db, "CREATE TABLE agenda (due_at INTEGER)");
+
+	test_group("status_file_write: counter unchanged");
+	memset(&status, 0, sizeof status);
+	status.written_at = 100;
+	status.until = 200;
+	status.due_count = 1;
+	status.due_array[0] = 150;
+	assert_equal("stamp", STATUS_FILE_OK,
+	             status_file_stamp(TEST_PATH, &status));
+	assert_equal("write", STATUS_FILE_OK,
+	             status_file_write(TEST_PATH, &status));
+	assert_equal("read", STATUS_FILE_OK,
+	             status_file_read(TEST_PATH, 100, 200, &read));
+	assert_equal("read.due_count", 1, (int)read.due_count);
+	assert_equal("count", 1, (int)status_file_count(&read, 150));
+
+	test_group("status_file_write: commit after the stamp");
+	assert_equal("stamp", STATUS_FILE_OK,
+	             status_file_stamp(TEST_PATH, &status));
+	db_exec(db, "INSERT INTO agenda VALUES (150)");
+	assert_equal("write", STATUS_FILE_ESTALE,
+	             status_file_write(TEST_PATH, &status));
+	assert_equal("read", STATUS_FILE_ESTALE,
+	             status_file_read(TEST_PATH, 100, 200, &read));
+
+	test_group("status_file_stamp: WAL mode");
+	db_exec(db, "PRAGMA journal_mode=WAL");
+	assert_equal("stamp", STATUS_FILE_E,
+	             status_file_stamp(TEST_PATH, &status));
+
+	test_done();
+	sqlite3_close(db);
+	remove_all();
+	remove(TEST_PATH "-wal");
+	remove(TEST_PATH "-shm");
+	return 0;
+}
@@ -0,0 +1,248 @@
+/* ISC License
+ *
+ * Copyright (c) 2025 Thiago Negri
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+/* The database code of the app is all static, it's pulled in whole. */
+#define main ysarys_main
+#include "../app/ysarys.c"
+#undef main
+
+const char *current_group;
+
+void
+fail(const char *message, int expected, int actual)
+{
+	const char *format = current_group
+	                         ? "\nFAIL: %s (expected: %d, actual: %d)\n"
+	                         : "FAIL: %s (expected: %d, actual: %d)\n";
+	fprintf(stderr, format, message, expected, actual);
+	exit(EXIT_FAILURE);
+}
+
+void
+assert_equal(const char *message, int expected, int actual)
+{
+	if (expected != actual)
+		fail(message, expected, actual);
+}
+
+void
+test_group(const char *group)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	fprintf(stderr, "> %s", group);
+	current_group = group;
+}
+
+void
+test_done(void)
+{
+	if (current_group)
+		fprintf(stderr, " OK\n");
+	current_group = NULL;
+}
+
+void
+exec_sql(sqlite3 *db, const char *sql)
+{
+	assert_equal(sql, SQLITE_OK, sqlite3_exec(db, sql, NULL, NULL, NULL));
+}
+
+/* The single integer `sql` selects. */
+int
+select_int(sqlite3 *db, const char *sql)
+{
+	sqlite3_stmt *stmt = NULL;
+	int value = 0;
+
+	assert_equal(sql, SQLITE_OK,
+	             sqlite3_prepare_v2(db, sql, -1, &stmt, NULL));
+	assert_equal(sql, SQLITE_ROW, sqlite3_step(stmt));
+	value = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return value;
+}
+
+/* A migrated database in memory, with a cache for it. */
+void
+db_open(sqlite3 **ret_db, struct db_stmt_cache *cache)
+{
+	assert_equal("open", SQLITE_OK, sqlite3_open(":memory:", ret_db));
+	assert_equal("migrate", DB_MIGRATE_OK, db_migrate(*ret_db));
+	db_stmt_cache_init(cache, *ret_db);
+}
+
+void
+db_close(sqlite3 *db, struct db_stmt_cache *cache)
+{
+	db_stmt_cache_finalize(cache);
+	assert_equal("close", SQLITE_OK, sqlite3_close(db));
+}
+
+/* Scratch file for what the listing prints, in the directory tests run
+ * from. */
+#define LIST_PATH "ysarys.test.txt"
+
+/* Entries listed, a few pages of them. */
+#define LIST_ENTRY_COUNT (2 * AGENDA_LIST_PAGE_COUNT + 10)
+
+/* The listing in LIST_PATH has entries 0 to `count` - 1, each once, latest
+ * first. */
+void
+assert_list(int count)
+{
+	static char seen[LIST_ENTRY_COUNT + 1];
+	char line[256];
+	char date[16];
+	char last_date[16] = "9999-99-99";
+	int last_id = 0;
+	int line_count = 0;
+	int order = 0;
+	int id = 0;
+	int n = 0;
+	FILE *fd = NULL;
+
+	memset(seen, 0, sizeof seen);
+	fd = fopen(LIST_PATH, "r");
+	assert_equal("fopen", 1, fd != NULL);
+	while (fgets(line, sizeof line, fd) != NULL)
+	{
+		assert_equal("line", 3,
+		             sscanf(strstr(line, "-- ") + 3,
+		                    "%10s %d entry-%d", date, &id, &n));
+		assert_equal("entry", 1, n >= 0 && n < count);
+		assert_equal("seen once", 0, seen[n]++);
+		order = strcmp(date, last_date);
+		assert_equal("latest first", 1,
+		             order < 0 || (order == 0 && id < last_id));
+		strcpy(last_date, date);
+		last_id = id;
+		line_count++;
+	}
+	fclose(fd);
+	assert_equal("line count", count, line_count);
+}
+
+int
+main(void)
+{
+	struct db_stmt_cache cache = DB_STMT_CACHE_ZERO;
+	sqlite3 *db = NULL;
+	daynum today = 20000;
+	daynum day = 0;
+	char sql[256];
+	int i = 0;
+
+	test_group("scheduler_populate: a failed insert rolls back the run");
+	db_open(&db, &cache);
+	exec_sql(db, "INSERT INTO scheduler (rule, description, tags_csv, "
+	             "monetary_value, created_at) "
+	             "VALUES ('*', 'daily', 'daily', 0, 0)");
+	sprintf(sql,
+	        "CREATE TRIGGER agenda_fail BEFORE INSERT ON agenda "
+	        "WHEN NEW.due_at = %ld BEGIN SELECT RAISE(ABORT, 'test'); "
+	        "END",
+	        (long)day_to_timestamp(today + 30));
+	exec_sql(db, sql);
+	/* The failure is logged, on a line of its own. */
+	fprintf(stderr, "\n");
+	assert_equal("populate", YSARYS_E,
+	             scheduler_populate(&cache, today, 0));
+	assert_equal("no transaction left", 1, sqlite3_get_autocommit(db) != 0);
+	assert_equal("no entries", 0,
+	             select_int(db, "SELECT COUNT(1) FROM agenda"));
+	assert_equal("no last_run", 0,
+	             select_int(db, "SELECT COUNT(1) FROM scheduler_control"));
+	assert_equal("no blob", 0,
+	             select_int(db, "SELECT COUNT(rule_blob) FROM scheduler"));
+	exec_sql(db, "DROP TRIGGER agenda_fail");
+	assert_equal("populate", YSARYS_OK,
+	             scheduler_populate(&cache, today, 0));
+	assert_equal("entries", 61,
+	             select_int(db, "SELECT COUNT(1) FROM agenda"));
+	assert_equal("last_run", 1,
+	             select_int(db, "SELECT COUNT(1) FROM scheduler_control"));
+	db_close(db, &cache);
+
+	test_group("db_migrate: duplicates dropped before the unique index");
+	db_open(&db, &cache);
+	/* Back to before the migration, with a scheduler's entry twice on a
+	 * day and entries added by hand, which have no scheduler. */
+	exec_sql(db, "DROP INDEX agenda_scheduler_due");
+	exec_sql(db, "DELETE FROM z_migrate WHERE filename = "
+	             "'20261017120100_agenda_scheduler_due_unique.sql'");
+	exec_sql(db, "INSERT INTO agenda (id, scheduler_id, description, "
+	             "due_at) VALUES (1, 7, 'kept', 100), "
+	             "(2, 7, 'dropped', 100), (3, 7, 'other day', 200), "
+	             "(4, 8, 'other scheduler', 100), "
+	             "(5, NULL, 'by hand', 100), (6, NULL, 'by hand', 100)");
+	assert_equal("migrate", DB_MIGRATE_OK, db_migrate(db));
+	assert_equal("entries", 5,
+	             select_int(db, "SELECT COUNT(1) FROM agenda"));
+	assert_equal("oldest kept", 0,
+	             select_int(db, "SELECT COUNT(1) FROM agenda "
+	                            "WHERE id = 2"));
+	assert_equal("index", 1,
+	             select_int(db, "SELECT COUNT(1) FROM sqlite_schema "
+	                            "WHERE name = 'agenda_scheduler_due'"));
+
+	test_group("agenda_insert: a scheduler's day is inserted once");
+	assert_equal("insert", YSARYS_OK,
+	             agenda_insert(&cache, 7, "again", 5, "", 0, 0, 100));
+	assert_equal("insert", YSARYS_OK,
+	             agenda_insert(&cache, 7, "new day", 7, "", 0, 0, 300));
+	assert_equal("insert", YSARYS_OK,
+	             agenda_insert(&cache, 7, "new day", 7, "", 0, 0, 300));
+	assert_equal("entries", 6,
+	             select_int(db, "SELECT COUNT(1) FROM agenda"));
+	assert_equal("first kept", 1,
+	             select_int(db, "SELECT COUNT(1) FROM agenda WHERE "
+	                            "scheduler_id = 7 AND due_at = 100 AND "
+	                            "description = 'kept'"));
+	db_close(db, &cache);
+
+	test_group("agenda_list_due: pages of entries due at the same time");
+	db_open(&db, &cache);
+	/* Most of them on one day, across a few pages, and one past what is
+	 * listed. */
+	for (i = 0; i <= LIST_ENTRY_COUNT; i++)
+	{
+		if (i < 5)
+			day = today - 1;
+		else if (i < LIST_ENTRY_COUNT - 5)
+			day = today + 1;
+		else if (i < LIST_ENTRY_COUNT)
+			day = today + 3;
+		else
+			day = today + 4;
+		sprintf(sql,
+		        "INSERT INTO agenda (description, due_at) "
+		        "VALUES ('entry-%d', %ld)",
+		        i, (long)day_to_timestamp(day));
+		exec_sql(db, sql);
+	}
+	fflush(stdout);
+	assert_equal("stdout", 1, freopen(LIST_PATH, "w", stdout) != NULL);
+	assert_equal("list", YSARYS_OK,
+	             agenda_list_due(&cache, today, today + 1, today + 3));
+	fflush(stdout);
+	assert_list(LIST_ENTRY_COUNT);
+	remove(LIST_PATH);
+	db_close(db, &cache);
+
+	test_done();
+	return 0;
+}